@@ -6,6 +6,9 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdint.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif // _WIN32
 
 // macros
 typedef struct {
@@ -73,6 +76,9 @@ char* ali_static_vsprintf(const char* fmt, va_list args);
 __attribute__((__format__(printf, 1, 2)))
 char* ali_static_sprintf(const char* fmt, ...);
 bool ali_mem_eq(const void* a, const void* b, ali_usize size);
+ali_u64 ali_monotonic_ns(void);
+// fast non-cryptographic hash, different seeds give independent hashes
+ali_u64 ali_hash_bytes(const void* data, ali_usize size, ali_u64 seed);
 char* ali_text_format(char* buffer, ali_usize buffer_size, const char* fmt, ...);
 
 ali__dump_number_decl(ali_dump_int, int);
@@ -208,17 +214,6 @@ extern Ali_Allocator ali_global_allocator;
 
 void ali_ensure_allocator_is_valid(Ali_Allocator* allocator);
 
-// temporary buffer
-
-#ifndef ALI_TEMPBUF_SIZE
-#define ALI_TEMPBUF_SIZE (4 << 10)
-#endif // ALI_TEMPBUF_SIZE
-
-ali_usize ali_tstamp(void);
-void ali_trewind(ali_usize stamp);
-__attribute__((__format__(printf, 1, 2)))
-char* ali_tsprintf(const char* fmt, ...);
-
 // arena
 typedef struct {
     ali_usize size, capacity;
@@ -240,8 +235,11 @@ typedef struct Ali_Arena_Chunk {
     ali_u8 data[];
 }Ali_Arena_Chunk;
 
+// Chunks after end are kept around after a rollback/reset and reused before anything new is malloc'd
 typedef struct {
     Ali_Arena_Chunk* start, *end;
+    // if not 0, chunks after end are freed on rollback/reset once the arena holds more than this
+    ali_usize max_retained;
 }Ali_Dynamic_Arena;
 
 typedef struct {
@@ -249,18 +247,195 @@ typedef struct {
     ali_usize size;
 }Ali_Arena_Mark;
 
+typedef struct {
+    ali_usize chunks;
+    ali_usize used; // bytes handed out, including alignment padding
+    ali_usize reserved; // capacity of all chunks
+}Ali_Dynamic_Arena_Stats;
+
 Ali_Arena_Mark ali_dynamic_arena_mark(Ali_Dynamic_Arena* arena);
 void ali_dynamic_arena_rollback(Ali_Dynamic_Arena* arena, Ali_Arena_Mark mark);
+void ali_dynamic_arena_reset(Ali_Dynamic_Arena* arena);
+Ali_Dynamic_Arena_Stats ali_dynamic_arena_stats(Ali_Dynamic_Arena* arena);
 Ali_Allocator ali_dynamic_arena_allocator(Ali_Dynamic_Arena* arena);
 
+// scratch arenas
+// Every thread has ALI_SCRATCH_COUNT dynamic arenas of its own for temporary allocations.
+// ali_scratch_begin picks one the caller isn't already allocating in (pass the arenas the caller's
+// results go to as conflicts) and ali_scratch_end rolls it back to where it was.
+#ifndef ALI_SCRATCH_COUNT
+#define ALI_SCRATCH_COUNT 2
+#endif // ALI_SCRATCH_COUNT
+
+// what a scratch arena keeps around once it's rolled back
+#ifndef ALI_SCRATCH_MAX_RETAINED
+#define ALI_SCRATCH_MAX_RETAINED (1 << 20)
+#endif // ALI_SCRATCH_MAX_RETAINED
+
+typedef struct {
+    Ali_Dynamic_Arena* arena;
+    Ali_Arena_Mark mark;
+}Ali_Scratch;
+
+Ali_Scratch ali_scratch_begin(Ali_Dynamic_Arena** conflicts, ali_usize conflict_count);
+void ali_scratch_end(Ali_Scratch scratch);
+#define ali_scratch_allocator(scratch) ali_dynamic_arena_allocator((scratch).arena)
+
+// temporary strings, they live in the first scratch arena of the calling thread
+Ali_Arena_Mark ali_tstamp(void);
+void ali_trewind(Ali_Arena_Mark stamp);
+__attribute__((__format__(printf, 1, 2)))
+char* ali_tsprintf(const char* fmt, ...);
+
+// pool allocator
+// Blocks of up to ALI_POOL_MAX_BLOCK bytes are rounded up to a power of two and carved out of
+// ALI_POOL_SLAB_SIZE slabs, with a free list per size. Bigger blocks get a slab of their own.
+// Every slab is aligned to ALI_POOL_SLAB_SIZE and starts with its header, so ALI_FREE finds the
+// header of a block by rounding its pointer down. The slabs of the size classes are only given
+// back on ALI_FREEALL, the slab of a bigger block is given back as soon as the block is freed.
+#ifndef ALI_POOL_SLAB_SIZE
+#define ALI_POOL_SLAB_SIZE (64 << 10)
+#endif // ALI_POOL_SLAB_SIZE
+
+#define ALI_POOL_MIN_BLOCK 16
+#define ALI_POOL_MAX_BLOCK (4 << 10)
+#define ALI_POOL_CLASS_COUNT 9 // 16, 32, ..., ALI_POOL_MAX_BLOCK
+
+typedef struct Ali_Pool_Slab {
+    struct Ali_Pool_Slab* prev, *next;
+    ali_usize size; // of the whole slab, including this header
+    ali_usize block_size; // 0 for a slab holding one big block
+}Ali_Pool_Slab;
+
+typedef struct {
+    void* free_lists[ALI_POOL_CLASS_COUNT];
+    // the part of the newest slab of each class that hasn't been handed out yet
+    ali_u8* bump[ALI_POOL_CLASS_COUNT];
+    ali_u8* bump_end[ALI_POOL_CLASS_COUNT];
+    Ali_Pool_Slab* slabs;
+}Ali_Pool_Allocator;
+
+Ali_Allocator ali_pool_allocator(Ali_Pool_Allocator* pool);
+
+// atomic arena
+// An arena any number of threads can allocate from at the same time without a lock: ALLOC is
+// one fetch-add on the offset of the current chunk, and whoever finds it full installs the next
+// chunk with a compare-and-swap. ALI_REALLOC always copies and ALI_FREE does nothing.
+// Marks, rollbacks, resets and ALI_FREEALL are for when only one thread uses the arena, and
+// work like the ones of Ali_Dynamic_Arena (chunks after the mark are kept and reused).
+#ifndef ALI_ATOMIC_ARENA_CHUNK_SIZE
+#define ALI_ATOMIC_ARENA_CHUNK_SIZE (64 << 10)
+#endif // ALI_ATOMIC_ARENA_CHUNK_SIZE
+
+typedef struct Ali_Atomic_Chunk {
+    ali_usize size; // may go past capacity when threads race for the end of the chunk
+    ali_usize capacity;
+    struct Ali_Atomic_Chunk* next;
+    _Alignas(16) ali_u8 data[];
+}Ali_Atomic_Chunk;
+
+typedef struct {
+    Ali_Atomic_Chunk* first;
+    Ali_Atomic_Chunk* current;
+}Ali_Atomic_Arena;
+
+typedef struct {
+    Ali_Atomic_Chunk* target;
+    ali_usize size;
+}Ali_Atomic_Arena_Mark;
+
+Ali_Atomic_Arena_Mark ali_atomic_arena_mark(Ali_Atomic_Arena* arena);
+void ali_atomic_arena_rollback(Ali_Atomic_Arena* arena, Ali_Atomic_Arena_Mark mark);
+void ali_atomic_arena_reset(Ali_Atomic_Arena* arena);
+Ali_Allocator ali_atomic_arena_allocator(Ali_Atomic_Arena* arena);
+
+#ifndef _WIN32
+// virtual memory arena
+// Reserves address space up front and commits it as the arena grows, so the arena is contiguous,
+// pointers into it never move and it can grow to its reserve without copying.
+#ifndef ALI_VM_ARENA_COMMIT_SIZE
+#define ALI_VM_ARENA_COMMIT_SIZE (64 << 10)
+#endif // ALI_VM_ARENA_COMMIT_SIZE
+
+#ifndef ALI_HUGE_PAGE_SIZE
+#define ALI_HUGE_PAGE_SIZE (2 << 20)
+#endif // ALI_HUGE_PAGE_SIZE
+
+typedef enum {
+    ALI_PAGES_NORMAL = 0,
+    // madvise(MADV_HUGEPAGE), the kernel backs the arena with huge pages where it can
+    ALI_PAGES_TRANSPARENT_HUGE,
+    // MAP_HUGETLB, takes the huge pages for the whole reserve from /proc/sys/vm/nr_hugepages
+    // up front, falls back to ALI_PAGES_TRANSPARENT_HUGE if there aren't enough
+    ALI_PAGES_HUGETLB,
+}Ali_Page_Kind;
+
+typedef struct {
+    Ali_Page_Kind pages;
+    // only allocate memory on numa_node, ignored (with a warning) if the kernel can't do that
+    bool bind_numa_node;
+    int numa_node;
+}Ali_Vm_Arena_Options;
+
+typedef struct {
+    ali_u8* base;
+    ali_usize size;
+    ali_usize committed;
+    ali_usize reserved;
+    ali_usize commit_size; // ALI_VM_ARENA_COMMIT_SIZE, or ALI_HUGE_PAGE_SIZE with huge pages
+    // ali_vm_arena_reset gives everything committed above this back to the OS
+    ali_usize high_water_mark;
+}Ali_Vm_Arena;
+
+bool ali_vm_arena_init(Ali_Vm_Arena* arena, ali_usize reserve);
+bool ali_vm_arena_init_ex(Ali_Vm_Arena* arena, ali_usize reserve, Ali_Vm_Arena_Options options);
+void ali_vm_arena_reset(Ali_Vm_Arena* arena);
+void ali_vm_arena_destroy(Ali_Vm_Arena* arena);
+// ALI_FREEALL does ali_vm_arena_reset
+Ali_Allocator ali_vm_arena_allocator(Ali_Vm_Arena* arena);
+#endif // _WIN32
+
 // dynamic arrays (da)
+// The items live in the da's allocator (ali_libc_allocator if it was left zeroed), so a da whose
+// allocator is an arena doesn't need ali_da_free at all.
 #define DA(Type) Ali_Allocator allocator; Type* items; ali_usize count, capacity
+
+// the growth policy: the capacity of the first allocation, and the one after a given capacity
+#ifndef ALI_DA_INIT_CAPACITY
+#define ALI_DA_INIT_CAPACITY 8
+#endif // ALI_DA_INIT_CAPACITY
+
+#ifndef ALI_DA_GROW
+#define ALI_DA_GROW(capacity) ((capacity) * 3)
+#endif // ALI_DA_GROW
+
+#define ali__da_set_capacity(da, new_capacity) do { \
+        ali_usize ali__new_capacity = (new_capacity); \
+        (da)->items = ali_realloc_aligned_ex((da)->allocator, (da)->items, (da)->capacity * sizeof((da)->items[0]), \
+                                             ali__new_capacity * sizeof((da)->items[0]), __alignof__((da)->items[0])); \
+        (da)->capacity = ali__new_capacity; \
+    } while (0)
+// makes room for item_count more items, plus one spare (the NUL of an Ali_Sb)
 #define ali_da_resize_for(da, item_count) do {\
         ali_ensure_allocator_is_valid(&(da)->allocator); \
         if ((da)->count + (item_count) >= (da)->capacity) { \
-            if ((da)->capacity == 0) (da)->capacity = 8; \
-            while ((da)->count + (item_count) >= (da)->capacity) (da)->capacity *= 3; \
-            (da)->items = realloc((da)->items, (da)->capacity * sizeof((da)->items[0])); \
+            ali_usize ali__capacity = (da)->capacity == 0 ? ALI_DA_INIT_CAPACITY : (da)->capacity; \
+            while ((da)->count + (item_count) >= ali__capacity) ali__capacity = ALI_DA_GROW(ali__capacity); \
+            ali__da_set_capacity(da, ali__capacity); \
+        } \
+    } while (0)
+// like ali_da_resize_for, but grows to exactly what is needed instead of following ALI_DA_GROW
+#define ali_da_reserve(da, item_count) do {\
+        ali_ensure_allocator_is_valid(&(da)->allocator); \
+        if ((da)->count + (item_count) >= (da)->capacity) ali__da_set_capacity(da, (da)->count + (item_count) + 1); \
+    } while (0)
+// gives back all the capacity past count
+#define ali_da_shrink_to_fit(da) do {\
+        if ((da)->count == 0) { \
+            ali_da_free(da); \
+        } else if ((da)->count < (da)->capacity) { \
+            ali_ensure_allocator_is_valid(&(da)->allocator); \
+            ali__da_set_capacity(da, (da)->count); \
         } \
     } while (0)
 #define ali_da_append(da, item) do { \
@@ -297,27 +472,105 @@ Ali_Allocator ali_dynamic_arena_allocator(Ali_Dynamic_Arena* arena);
         (da)->count--; \
     } while (0)
 #define ali_da_clear(da) (da)->count = 0
-#define ali_da_free(da) (free((da)->items), (da)->items = NULL, (da)->capacity = 0, (da)->count = 0)
-#define ali_da_foreach(da, Type, ptr) for (Type* ptr = (da)->items; (uintptr_t)ptr < (uintptr_t)(da)->items + (da)->count; ++ptr)
+#define ali_da_free(da) (ali_ensure_allocator_is_valid(&(da)->allocator), \
+                        (da)->items != NULL ? ali_free_ex((da)->allocator, (da)->items) : NULL, \
+                        (da)->items = NULL, (da)->capacity = 0, (da)->count = 0)
+#define ali_da_foreach(da, Type, ptr) for (Type* ptr = (da)->items; ptr < (da)->items + (da)->count; ++ptr)
 
 typedef struct {
     DA(char*);
 }Ali_Cstrs;
 
+#ifndef _WIN32
+// thread cached allocator
+// Puts a per-thread cache in front of any (not necessarily thread safe) allocator. Each thread
+// keeps a magazine of free blocks per size class and only takes the lock to swap a whole magazine
+// with the shared depot when its own runs empty or full. Blocks may be freed by any thread, they
+// just end up in that thread's cache. Blocks over ALI_THREAD_CACHE_MAX_BLOCK bytes or aligned to
+// more than 16 bytes go straight to the backing allocator.
+#ifndef ALI_MAGAZINE_SIZE
+#define ALI_MAGAZINE_SIZE 64
+#endif // ALI_MAGAZINE_SIZE
+
+#ifndef ALI_THREAD_CACHE_CHUNK_SIZE
+#define ALI_THREAD_CACHE_CHUNK_SIZE (64 << 10)
+#endif // ALI_THREAD_CACHE_CHUNK_SIZE
+
+#define ALI_THREAD_CACHE_MAX_BLOCK (2 << 10)
+#define ALI_THREAD_CACHE_CLASS_COUNT 8 // 16, 32, ..., ALI_THREAD_CACHE_MAX_BLOCK
+
+typedef struct {
+    ali_usize count;
+    void* blocks[ALI_MAGAZINE_SIZE];
+}Ali_Magazine;
+
+typedef struct {
+    DA(Ali_Magazine*);
+}Ali_Magazines;
+
+typedef struct {
+    Ali_Allocator backing; // only ever called with lock held
+    pthread_mutex_t lock;
+    pthread_key_t key; // the calling thread's cache
+
+    // the depot
+    Ali_Magazines magazines[ALI_THREAD_CACHE_CLASS_COUNT]; // with at least one block
+    Ali_Magazines empty;
+    struct { DA(void*); } chunks; // blocks are carved out of these
+    ali_u8* bump;
+    ali_u8* bump_end;
+}Ali_Thread_Cache_Allocator;
+
+bool ali_thread_cache_allocator_init(Ali_Thread_Cache_Allocator* tc, Ali_Allocator backing);
+// Every other thread that used tc has to have exited by now
+void ali_thread_cache_allocator_destroy(Ali_Thread_Cache_Allocator* tc);
+// ALI_FREEALL does nothing, use ali_thread_cache_allocator_destroy
+Ali_Allocator ali_thread_cache_allocator(Ali_Thread_Cache_Allocator* tc);
+#endif // _WIN32
+
 // tracking allocator
+// Wraps an allocator and keeps stats per call site of what goes through it. Live allocations are
+// found by pointer in an open addressing table, so ALI_FREE doesn't search anything. With a
+// sample_rate of N > 1 only about one in N allocated bytes gets tracked: an allocation of size
+// bytes is picked with a chance of size/N and then counts as N bytes (bigger ones always get
+// picked and count as themselves), which keeps the totals right on average. Not thread safe.
 typedef struct {
     Ali_Location loc;
-    ali_usize size;
-    void* ptr;
+    ali_usize live_bytes;
+    ali_usize live_allocs;
+    ali_usize peak_bytes;
+    ali_usize total_bytes;
+    ali_usize total_allocs;
+}Ali_Allocation_Site;
+
+typedef struct {
+    void* ptr; // NULL for an empty slot
+    ali_usize weight; // bytes this allocation stands for
+    ali_u32 site;
 }Ali_Tracked_Allocation;
 
 typedef struct {
-    DA(Ali_Tracked_Allocation);
+    Ali_Allocator backing;
+    ali_usize sample_rate; // 0 or 1 tracks every allocation
+
+    Ali_Tracked_Allocation* allocations;
+    ali_usize allocations_count, allocations_capacity;
+
+    struct { DA(Ali_Allocation_Site); } sites;
+    ali_u32* site_slots; // open addressing table of site index + 1, 0 for an empty slot
+    ali_usize site_slots_capacity;
+
+    ali_u64 rng;
+    ali_usize live_bytes;
+    ali_usize peak_bytes;
 }Ali_Tracking_Allocator;
 
 Ali_Tracking_Allocator ali_track_allocator(Ali_Allocator allocator);
 Ali_Allocator ali_tracking_allocator(Ali_Tracking_Allocator* allocator);
-void ali_log_tracked(Ali_Tracking_Allocator allocator);
+// logs the top_n call sites by live bytes (or all of them if top_n is 0)
+void ali_log_tracked(Ali_Tracking_Allocator* allocator, ali_usize top_n);
+// frees what the tracking allocator uses itself, not the tracked allocations
+void ali_tracking_allocator_free(Ali_Tracking_Allocator* allocator);
 
 // string view (sv)
 typedef struct {
@@ -336,6 +589,36 @@ Ali_Sv ali_sv_strip_prefix(Ali_Sv self, Ali_Sv prefix);
 bool ali_sv_ends_with_suffix(Ali_Sv self, Ali_Sv suffix);
 Ali_Sv ali_sv_strip_suffix(Ali_Sv self, Ali_Sv suffix);
 bool ali_sv_eq(Ali_Sv a, Ali_Sv b);
+// index of the first byte (or needle), -1 if there is none
+ali_isize ali_sv_find_byte(Ali_Sv self, char byte);
+ali_isize ali_sv_find(Ali_Sv self, Ali_Sv needle);
+ali_usize ali_sv_count_byte(Ali_Sv self, char byte);
+// returns what is before the first delim and moves self past it, or returns all of self
+Ali_Sv ali_sv_chop_by_delim(Ali_Sv* self, char delim);
+
+typedef struct {
+    DA(Ali_Sv);
+}Ali_Svs;
+
+// appends every part of self between delims to svs (empty ones too)
+void ali_sv_split_by(Ali_Sv self, char delim, Ali_Svs* svs);
+// parse the number at the start of self (base 10 or 16) and move self past it, false if there is none
+bool ali_sv_chop_u64(Ali_Sv* self, int base, ali_u64* n);
+bool ali_sv_chop_i64(Ali_Sv* self, ali_i64* n);
+
+// Walks an Ali_Sv (a mapped file, say) and hands out slices of it, nothing is copied:
+//     Ali_Tokenizer lines = ali_tokenizer(content);
+//     for (Ali_Sv line; ali_tokenizer_next_line(&lines, &line);) { ... }
+typedef struct {
+    Ali_Sv rest;
+    ali_usize line; // lines (or tokens) handed out so far
+}Ali_Tokenizer;
+
+#define ali_tokenizer(sv) ((Ali_Tokenizer) { .rest = (sv) })
+// the next line without its \n (or \r\n), the last one doesn't need to end with a \n
+bool ali_tokenizer_next_line(Ali_Tokenizer* tokenizer, Ali_Sv* line);
+// the next part up to delim, like ali_tokenizer_next_line there is no empty one at the very end
+bool ali_tokenizer_next(Ali_Tokenizer* tokenizer, char delim, Ali_Sv* token);
 
 // slices
 typedef struct {
@@ -354,6 +637,67 @@ Ali_Slice ali_slice_to_byte_slice(Ali_Slice slice);
 void* ali_slice_get(Ali_Slice slice, ali_usize index);
 #define ali_slice_foreach(slice, Type, ptr) for (Type* ptr = (slice).data; (ali_u8*)ptr < (ali_u8*)((slice).data + (slice).count * (slice).data_size); ptr++)
 
+// hash map (hm)
+// A Swiss table keyed by string views: every slot has a control byte with 7 bits of the hash of
+// its key, so a lookup checks 16 slots at once (with SSE2) and only compares the keys whose bits
+// match. Probing is linear and removing shifts the following keys back, so there are no
+// tombstones. Keys are not copied and have to outlive the map, and inserting invalidates
+// pointers to the values.
+#define ALI_HM_GROUP 16
+
+typedef struct {
+    Ali_Allocator allocator;
+    ali_u8* ctrl; // the first ALI_HM_GROUP - 1 bytes are repeated at the end, so a group never wraps
+    Ali_Sv* keys;
+    ali_usize count, capacity; // capacity is 0 or a power of two
+}Ali_Hm_Table;
+
+#define HM(Type) Ali_Hm_Table table; Type* values
+
+void* ali__hm_find(Ali_Hm_Table* table, void* values, ali_usize value_size, Ali_Sv key);
+ali_usize ali__hm_insert(Ali_Hm_Table* table, void** values, ali_usize value_size, Ali_Sv key, bool* existed);
+void* ali__hm_entry(Ali_Hm_Table* table, void** values, ali_usize value_size, Ali_Sv key, bool* existed);
+bool ali__hm_remove(Ali_Hm_Table* table, void* values, ali_usize value_size, Ali_Sv key);
+ali_usize ali__hm_next(Ali_Hm_Table* table, ali_usize slot);
+void ali__hm_clear(Ali_Hm_Table* table);
+void ali__hm_free(Ali_Hm_Table* table, void** values);
+
+// the value of key, or NULL
+#define ali_hm_find(hm, key) ali__hm_find(&(hm)->table, (hm)->values, sizeof((hm)->values[0]), key)
+// the value of key, zeroed if it was just inserted (then *existed is set to false, existed may be NULL)
+#define ali_hm_entry(hm, key, existed) ali__hm_entry(&(hm)->table, (void**)&(hm)->values, sizeof((hm)->values[0]), key, existed)
+#define ali_hm_put(hm, key, value) do { \
+        ali_static_assert(sizeof((hm)->values[0]) == sizeof(value)); \
+        ali_usize ali__slot = ali__hm_insert(&(hm)->table, (void**)&(hm)->values, sizeof((hm)->values[0]), key, NULL); \
+        (hm)->values[ali__slot] = (value); \
+    } while (0)
+#define ali_hm_remove(hm, key) ali__hm_remove(&(hm)->table, (hm)->values, sizeof((hm)->values[0]), key)
+#define ali_hm_count(hm) ((hm)->table.count)
+#define ali_hm_clear(hm) ali__hm_clear(&(hm)->table)
+#define ali_hm_free(hm) ali__hm_free(&(hm)->table, (void**)&(hm)->values)
+// slot goes over the slots with a key, that is (hm)->table.keys[slot] and its value (hm)->values[slot]
+#define ali_hm_foreach(hm, slot) for (ali_usize slot = ali__hm_next(&(hm)->table, 0); slot < (hm)->table.capacity; slot = ali__hm_next(&(hm)->table, slot + 1))
+
+// string interning
+// Stores every distinct string once, NUL-terminated in a dynamic arena, and numbers them, so two
+// interned strings are equal if their ids are. The Ali_Sv of an interned string (and its start
+// as a cstr) stays valid until ali_interner_free. Id 0 is never handed out.
+typedef struct {
+    ali_u32 id;
+    Ali_Sv sv;
+}Ali_Interned;
+
+typedef struct {
+    Ali_Dynamic_Arena arena;
+    struct { DA(Ali_Sv); } strs; // by id
+    struct { HM(ali_u32); } ids;
+}Ali_Interner;
+
+Ali_Interned ali_intern(Ali_Interner* interner, Ali_Sv sv);
+#define ali_intern_cstr(interner, cstr) ali_intern(interner, ali_sv_from_cstr(cstr))
+Ali_Sv ali_interner_get(Ali_Interner* interner, ali_u32 id);
+void ali_interner_free(Ali_Interner* interner);
+
 // string builder (sb)
 typedef struct {
     DA(char);
@@ -370,12 +714,46 @@ void ali_sb_render_cmd(Ali_Sb* sb, char** cmd, ali_usize cmd_count);
 bool ali_pipe2(int p[2]);
 #endif // _WIN32
 
+// Maps filepath read-only and points sv at its contents, so nothing is read until it's touched.
+// The file must not be truncated while mapped. On failure errno is set and nothing is logged.
+// (On Windows the file is just read into memory.)
+bool ali_sv_read_file_mmap(const char* filepath, Ali_Sv* sv);
+void ali_sv_unmap_file(Ali_Sv sv);
+
+// Remembers the result of stat() for every path, so a file is only stat'ed once no matter
+// how many times it is asked for. Must be invalidated for files that get changed.
+typedef struct {
+    char* path; // the key
+    bool valid;
+    bool exists;
+    int error; // errno of the failed stat()
+    ali_i64 mtime;
+}Ali_Stat_Entry;
+
+typedef struct {
+    HM(Ali_Stat_Entry);
+    ali_usize stat_calls;
+    ali_usize saved_calls;
+}Ali_Stat_Cache;
+
+// ali_file_mtime (and so ali_need_rebuild) goes through this if it's set,
+// ali_build_build sets it for the duration of the build
+extern Ali_Stat_Cache* ali_global_stat_cache;
+
+bool ali_stat_cache_mtime(Ali_Stat_Cache* cache, const char* filepath, ali_i64* mtime);
+void ali_stat_cache_invalidate(Ali_Stat_Cache* cache, const char* filepath);
+void ali_stat_cache_free(Ali_Stat_Cache* cache);
+
+// stores the modification time of filepath in nanoseconds
+bool ali_file_mtime(const char* filepath, ali_i64* mtime);
 bool ali_is_file1_modified_after_file2(const char* filepath1, const char* filepath2);
 #define ali_need_rebuild(target, source) ali_is_file1_modified_after_file2(source, target)
 bool ali_rename(const char* from, const char* to);
 bool ali_remove(const char* filepath);
 bool ali_mkdir_if_not_exists(const char* path);
 bool ali_mkdir_deep_if_not_exists(const char* path);
+// also copies the permissions, so executables stay executable
+bool ali_copy_file(const char* from, const char* to);
 
 // jobs
 #ifdef _WIN32
@@ -396,6 +774,13 @@ typedef ali_u32 AliJobRedirect;
 #define ALI_REDIRECT_STDERR 0x4
 
 Ali_Job ali_job_start(char** cmd, ali_usize cmd_count, AliJobRedirect redirect);
+// Same as ali_job_start, but argv has to end with NULL, so it doesn't need to be copied.
+// Jobs are started with posix_spawn, unless ALI_JOB_USE_FORK is defined.
+Ali_Job ali_job_start_argv(char** argv, AliJobRedirect redirect);
+#ifndef _WIN32
+Ali_Job ali_job_start_posix_fork(char** argv, AliJobRedirect redirect);
+Ali_Job ali_job_start_posix_spawn(char** argv, AliJobRedirect redirect);
+#endif // _WIN32
 bool ali_job_wait(Ali_Job job);
 bool ali_job_run(char **cmd, ali_usize cmd_count, AliJobRedirect redirect);
 
@@ -405,6 +790,10 @@ typedef struct {
 
 bool ali_jobs_wait(Ali_Jobs jobs);
 bool ali_jobs_wait_and_reset(Ali_Jobs* jobs);
+// Waits for whichever job of jobs exits first and stores its position in index.
+// The job is NOT removed from jobs. Other children of the process are left alone.
+// If waiting itself fails, returns false with index set to jobs->count (errno tells why).
+bool ali_jobs_wait_any(Ali_Jobs* jobs, ali_usize* index);
 
 // cmd abstraction
 typedef struct {
@@ -419,8 +808,47 @@ bool ali_cmd_run_sync(Ali_Cmd cmd);
 Ali_Job ali_cmd_run_async_and_reset(Ali_Cmd* cmd, AliJobRedirect redirect);
 bool ali_cmd_run_sync_and_reset(Ali_Cmd* cmd);
 
+// job pool
+// Runs jobs with their stdout/stderr captured and prints the output of each job in one piece
+// once it is done, so the output of parallel jobs doesn't get mixed up. Jobs are reaped in the
+// order they finish (poll() on the output pipes and pidfds).
+typedef struct {
+    Ali_Job job;
+    ali_usize id; // whatever the caller wants to know the job by
+    int pidfd; // -1 if the kernel doesn't have pidfd_open
+    bool exited;
+    bool eof;
+    bool wait_failed; // wstatus means nothing then, the job counts as failed
+    int wstatus;
+    long max_rss_kib;
+    ali_u64 start_ns;
+    ali_u64 end_ns; // when it was reaped
+    Ali_Sb output;
+}Ali_Pool_Job;
+
+typedef struct {
+    DA(Ali_Pool_Job);
+}Ali_Job_Pool;
+
+typedef struct {
+    bool reaped; // false if waiting itself failed, then none of the rest is set
+    ali_usize id;
+    bool ok;
+    int exit_code; // -1 if the job didn't exit normally
+    ali_u64 start_ns; // ali_monotonic_ns()
+    ali_u64 end_ns; // when it exited, not when its output was printed
+    long max_rss_kib; // peak resident set size of the job
+}Ali_Job_Result;
+
+// runs cmd and resets it
+bool ali_job_pool_start(Ali_Job_Pool* pool, Ali_Cmd* cmd, ali_usize id);
+// waits for whichever job finishes first, prints its output and removes it from the pool
+bool ali_job_pool_wait_any(Ali_Job_Pool* pool, Ali_Job_Result* result);
+bool ali_job_pool_wait_all(Ali_Job_Pool* pool);
+void ali_job_pool_free(Ali_Job_Pool* pool);
+
 #define ALI_REBUILD_YOURSELF(cmd, argc, argv) do { \
-        ali_usize stamp = ali_tstamp(); \
+        Ali_Arena_Mark stamp = ali_tstamp(); \
         char* program = (argv)[0]; \
         char* old_program = ali_tsprintf("%s.old", program); \
         char* source = __FILE__; \
@@ -438,11 +866,17 @@ bool ali_cmd_run_sync_and_reset(Ali_Cmd* cmd);
 
 // build
 
+// .c srcs of executables and libraries are compiled to objects in here
+#ifndef ALI_BUILD_DIR
+#define ALI_BUILD_DIR ".build"
+#endif // ALI_BUILD_DIR
+
 typedef enum {
     ALI_STEP_FILE,
     ALI_STEP_EXE,
     ALI_STEP_STATIC,
     ALI_STEP_DYNAMIC,
+    ALI_STEP_OBJECT,
 }Ali_Step_Type;
 
 typedef enum {
@@ -475,11 +909,134 @@ struct Ali_Step {
     Ali_Steps srcs; // this WILL be passed to the compiler/ar (ex. source files)
     Ali_Steps deps; // this WILL NOT be passed to the compiler (ex. header files)
     Ali_Cstrs linker_flags; // linker flags (passed as -Wl,%s)
+
+    // If > 1, the .c srcs are compiled unity_batch at a time through generated files that
+    // just #include them (<build_dir>/<name>/unity_<n>.c), so shared headers get parsed once
+    // per batch instead of once per src. The batches still compile in parallel.
+    // srcs of a batch share one TU, so their static names and macros must not clash.
+    ali_usize unity_batch;
 };
 
+typedef struct {
+    DA(ali_usize);
+}Ali_Indices;
+
+// headers of an object, as reported by the compiler in its depfile (-MMD -MF)
+typedef struct {
+    char* target;
+    ali_i64 mtime; // of the depfile when it was parsed
+    Ali_Cstrs headers; // interned in Ali_Depfiles.headers_interner
+}Ali_Depfile;
+
+typedef struct {
+    DA(Ali_Depfile);
+    struct { HM(ali_usize); } index; // target -> index into items
+    // the same headers show up in the depfiles of most objects, so they are stored once
+    Ali_Interner headers_interner;
+    bool dirty;
+}Ali_Depfiles;
+
+// appends every prerequisite of the first rule in content to headers, interned in interner
+void ali_depfile_parse(Ali_Sv content, Ali_Interner* interner, Ali_Cstrs* headers);
+Ali_Depfile* ali_depfiles_find(Ali_Depfiles* depfiles, const char* target);
+// parses depfile_path again only if it changed since the last time it was parsed
+Ali_Depfile* ali_depfiles_update(Ali_Depfiles* depfiles, const char* target, const char* depfile_path);
+bool ali_depfiles_load(Ali_Depfiles* depfiles, const char* path);
+bool ali_depfiles_save(Ali_Depfiles* depfiles, const char* path);
+void ali_depfiles_free(Ali_Depfiles* depfiles);
+
+// What an output was built from the last time, so deciding whether it is up to date
+// takes one stat per file and no walking of the graph (like ninja's .ninja_log).
+typedef struct {
+    const char* path; // interned in Ali_Build_Log.paths
+    ali_i64 mtime;
+}Ali_Build_Log_Input;
+
+typedef struct {
+    char* output;
+    ali_u64 cmd_hash;
+    ali_i64 mtime; // of the output right after it was built
+    struct { DA(Ali_Build_Log_Input); } inputs; // srcs, deps and then headers
+}Ali_Build_Log_Entry;
+
+typedef struct {
+    DA(Ali_Build_Log_Entry);
+    struct { HM(ali_usize); } index; // output -> index into items
+    Ali_Interner paths; // of the inputs, headers are inputs of most entries
+    bool dirty;
+}Ali_Build_Log;
+
+Ali_Build_Log_Entry* ali_build_log_find(Ali_Build_Log* log, const char* output);
+// replaces the inputs if output is already in the log
+Ali_Build_Log_Entry* ali_build_log_record(Ali_Build_Log* log, const char* output, ali_u64 cmd_hash, ali_i64 mtime);
+void ali_build_log_add_input(Ali_Build_Log* log, Ali_Build_Log_Entry* entry, const char* path, ali_i64 mtime);
+bool ali_build_log_load(Ali_Build_Log* log, const char* path);
+bool ali_build_log_save(Ali_Build_Log* log, const char* path);
+void ali_build_log_free(Ali_Build_Log* log);
+
+typedef enum {
+    ALI_NODE_WAITING = 0,
+    ALI_NODE_RUNNING,
+    ALI_NODE_DONE,
+    ALI_NODE_FAILED,
+}Ali_Build_Node_State;
+
+// A step as seen by the scheduler. Steps with the same name are merged into one node,
+// so the steps form a DAG even if substeps are copied around by value.
+typedef struct {
+    Ali_Step_Type type;
+    char* name;
+    bool owns_name;
+    Ali_Step* step; // the step this node was created from (for objects of .c srcs, the step that links them)
+    char* generated; // content of a generated src (the unity files), written out when the node runs
+
+    Ali_Indices srcs; // indices into Ali_Build_Nodes
+    Ali_Indices deps;
+    Ali_Indices dependents; // nodes that have this node in srcs/deps
+
+    Ali_Build_Node_State state;
+    ali_usize pending; // srcs/deps that haven't finished yet
+    bool rebuilt;
+
+    // hash of the cmd and the srcs/deps, see Ali_Build.cache_dir
+    ali_u64 cache_key[2];
+    bool has_cache_key;
+
+    ali_u64 cmd_hash;
+    // the output is stat'ed at most once per build
+    bool stated;
+    bool exists;
+    ali_i64 mtime;
+
+    // profile of the last build, only meaningful if worked is set
+    bool worked; // the cmd was run or the output was restored from the cache
+    bool from_cache;
+    ali_u64 start_ns;
+    ali_u64 end_ns;
+    int exit_code;
+    long max_rss_kib;
+    ali_usize lane; // which of the cores it ran on
+}Ali_Build_Node;
+
+typedef struct {
+    DA(Ali_Build_Node);
+    struct { HM(ali_usize); } by_name; // name -> index into items
+    const char* build_dir;
+    Ali_Depfiles depfiles; // cached in <build_dir>/deps between builds
+    Ali_Build_Log log; // cached in <build_dir>/log between builds
+    const char* cache_dir;
+    ali_u64 start_ns;
+    ali_u64 end_ns;
+}Ali_Build_Nodes;
+
 typedef struct {
     DA(Ali_Step);
-    Ali_Jobs jobs;
+    Ali_Job_Pool jobs;
+    Ali_Build_Nodes nodes;
+    const char* build_dir; // NULL means ALI_BUILD_DIR
+    // If set, every output is stored in here under a hash of its cmd and the contents of
+    // its inputs (and headers), and restored from here instead of running the cmd again.
+    const char* cache_dir;
 }Ali_Build;
 
 void ali_step_free(Ali_Step* step);
@@ -487,20 +1044,34 @@ Ali_Step ali_step_file(char* name);
 Ali_Step ali_step_executable(char* name, Ali_Debug_Type debug, Ali_Optimize_Type optimize);
 Ali_Step ali_step_dynamic(char* name, Ali_Debug_Type debug, Ali_Optimize_Type optimize);
 Ali_Step ali_step_static(char* name, Ali_Debug_Type debug, Ali_Optimize_Type optimize);
+Ali_Step ali_step_object(char* name, Ali_Debug_Type debug, Ali_Optimize_Type optimize);
 
 void ali_step_add_src(Ali_Step* step, Ali_Step substep);
 void ali_step_add_dep(Ali_Step* step, Ali_Step substep);
 
 bool ali_step_need_rebuild(Ali_Step* step);
-bool ali_step_build(Ali_Step* step, Ali_Jobs* jobs, ali_usize cores);
+bool ali_step_build(Ali_Step* step, Ali_Job_Pool* jobs, ali_usize cores);
+
+// .c srcs of ALI_STEP_EXE/STATIC/DYNAMIC are compiled separately (or in batches, see
+// Ali_Step.unity_batch) into objects under nodes->build_dir and only the objects get linked
+ali_usize ali_build_nodes_add_step(Ali_Build_Nodes* nodes, Ali_Step* step);
+void ali_build_nodes_free(Ali_Build_Nodes* nodes);
+// Chrome trace event format, open in chrome://tracing or https://ui.perfetto.dev
+// ali_build_nodes_run writes one to <build_dir>/trace.json after every build that ran something
+bool ali_build_nodes_write_trace(Ali_Build_Nodes* nodes, const char* path);
+// logs the chain of nodes that took the longest to build one after another
+void ali_build_nodes_report_critical_path(Ali_Build_Nodes* nodes);
+// Runs every node of the graph once all of its srcs/deps are done, keeping at most
+// cores jobs running at the same time.
+bool ali_build_nodes_run(Ali_Build_Nodes* nodes, Ali_Job_Pool* jobs, ali_usize cores);
 
 #define ali_build_install ali_da_append
 
 void ali_build_free(Ali_Build* b);
 bool ali_build_build(Ali_Build* b, ali_usize cores);
 
-// Gets to each step and does ali_da_remove(step->name)
-// !!! Except the ones that have type ALI_STEP_FILE !!!
+// Gets to each step (and object of a .c src, with its .d) and does ali_remove(step->name) if it exists
+// !!! Except the ones that have type ALI_STEP_FILE, other than the generated unity files !!!
 bool ali_build_clean(Ali_Build* b);
 
 #endif // ALI2_H
@@ -513,12 +1084,28 @@ bool ali_build_clean(Ali_Build* b);
 
 #ifndef _WIN32
 #include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <poll.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
 #else // _WIN32
 #include <windows.h>
 #endif // _WIN32
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
+
+// the byte loops below pick SSE2 or AVX2 at runtime, whatever the flags the library is built with
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define ALI__SIMD_X86
+#include <immintrin.h>
+#endif // x86
+
 #ifndef ALI_REMOVE_ASSERT
 void ali_assert_with_loc(const char* expr, bool ok, Ali_Location loc) {
     if (!ok) {
@@ -562,15 +1149,314 @@ char* ali_static_sprintf(const char* fmt, ...) {
     return str;
 }
 
-bool ali_mem_eq(const void* a, const void* b, ali_usize size) {
-    const char* ab = a;
-    const char* bb = b;
-    for (ali_usize i = 0; i < size; ++i) {
-        if (ab[i] != bb[i]) return false;
+bool ali__mem_eq_scalar(const ali_u8* a, const ali_u8* b, ali_usize size) {
+    ali_usize i = 0;
+    for (; i + 8 <= size; i += 8) {
+        ali_u64 x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (x != y) return false;
+    }
+    for (; i < size; ++i) {
+        if (a[i] != b[i]) return false;
     }
     return true;
 }
 
+ali_isize ali__find_byte_scalar(const ali_u8* data, ali_usize size, ali_u8 byte) {
+    for (ali_usize i = 0; i < size; ++i) {
+        if (data[i] == byte) return i;
+    }
+    return -1;
+}
+
+ali_usize ali__count_byte_scalar(const ali_u8* data, ali_usize size, ali_u8 byte) {
+    ali_usize count = 0;
+    for (ali_usize i = 0; i < size; ++i) count += data[i] == byte;
+    return count;
+}
+
+#ifdef ALI__SIMD_X86
+// The kernels below only run the scalar loop under one vector. Past that, mem_eq and find_byte
+// finish with one last vector that overlaps what was already looked at, which is fine for both
+// since everything before it was equal / had no match.
+
+// 8 to 15 bytes as two overlapping words: a byte of x ^ needle is zero where it matches, and the
+// lowest byte the zero byte trick flags is always a real match (only bytes above it can be wrong)
+static inline ali_isize ali__find_byte_short(const ali_u8* data, ali_usize size, ali_u8 byte) {
+    if (size < 8) return ali__find_byte_scalar(data, size, byte);
+
+    ali_u64 ones = 0x0101010101010101ull;
+    ali_u64 x, y;
+    memcpy(&x, data, 8);
+    memcpy(&y, data + size - 8, 8);
+    x ^= ones * byte;
+    y ^= ones * byte;
+    ali_u64 x_zeros = (x - ones) & ~x & (ones << 7);
+    if (x_zeros != 0) return __builtin_ctzll(x_zeros) / 8;
+    ali_u64 y_zeros = (y - ones) & ~y & (ones << 7);
+    if (y_zeros != 0) return size - 8 + __builtin_ctzll(y_zeros) / 8;
+    return -1;
+}
+
+__attribute__((target("sse2")))
+bool ali__mem_eq_sse2(const ali_u8* a, const ali_u8* b, ali_usize size) {
+    if (size < 16) return ali__mem_eq_scalar(a, b, size);
+
+    ali_usize i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m128i eq = _mm_and_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i))),
+                          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i + 16)), _mm_loadu_si128((const __m128i*)(b + i + 16)))),
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i + 32)), _mm_loadu_si128((const __m128i*)(b + i + 32))),
+                          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i + 48)), _mm_loadu_si128((const __m128i*)(b + i + 48)))));
+        if (_mm_movemask_epi8(eq) != 0xffff) return false;
+    }
+    for (; i + 16 <= size; i += 16) {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+        if (_mm_movemask_epi8(eq) != 0xffff) return false;
+    }
+    if (i == size) return true;
+    __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + size - 16)), _mm_loadu_si128((const __m128i*)(b + size - 16)));
+    return _mm_movemask_epi8(eq) == 0xffff;
+}
+
+__attribute__((target("sse2")))
+ali_isize ali__find_byte_sse2(const ali_u8* data, ali_usize size, ali_u8 byte) {
+    if (size < 16) return ali__find_byte_short(data, size, byte);
+
+    __m128i needle = _mm_set1_epi8(byte);
+    ali_usize i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m128i m0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i)), needle);
+        __m128i m1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i + 16)), needle);
+        __m128i m2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i + 32)), needle);
+        __m128i m3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i + 48)), needle);
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(m0, m1), _mm_or_si128(m2, m3))) == 0) continue;
+
+        ali_u64 mask = (ali_u64)_mm_movemask_epi8(m0) | (ali_u64)_mm_movemask_epi8(m1) << 16 |
+                       (ali_u64)_mm_movemask_epi8(m2) << 32 | (ali_u64)_mm_movemask_epi8(m3) << 48;
+        return i + __builtin_ctzll(mask);
+    }
+    for (; i + 16 <= size; i += 16) {
+        ali_u32 mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i)), needle));
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    if (i == size) return -1;
+    ali_u32 mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + size - 16)), needle));
+    return mask != 0 ? (ali_isize)(size - 16 + __builtin_ctz(mask)) : -1;
+}
+
+// Matches are counted per byte lane (cmpeq gives -1) and summed with psadbw before a lane can
+// overflow, so this doesn't need popcnt, which isn't there on every x86-64.
+__attribute__((target("sse2")))
+ali_usize ali__count_byte_sse2(const ali_u8* data, ali_usize size, ali_u8 byte) {
+    __m128i needle = _mm_set1_epi8(byte);
+    __m128i zero = _mm_setzero_si128();
+    ali_usize count = 0;
+    ali_usize i = 0;
+    while (i + 16 <= size) {
+        __m128i lanes = zero;
+        for (ali_usize n = 0; n < 255 && i + 16 <= size; ++n, i += 16) {
+            lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i)), needle));
+        }
+        __m128i sums = _mm_sad_epu8(lanes, zero);
+        count += (ali_usize)_mm_cvtsi128_si32(sums) + (ali_usize)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+    }
+    return count + ali__count_byte_scalar(data + i, size - i, byte);
+}
+
+// The avx2 kernels do their own 16 byte steps (VEX encoded here) instead of calling the sse2
+// ones, and clear the upper halves of the ymm registers before every return: legacy SSE code
+// running with them dirty, in here or in the caller, pays for a state transition every time.
+
+__attribute__((target("avx2")))
+bool ali__mem_eq_avx2(const ali_u8* a, const ali_u8* b, ali_usize size) {
+    if (size < 16) return ali__mem_eq_scalar(a, b, size);
+    if (size < 32) {
+        __m128i x = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)a), _mm_loadu_si128((const __m128i*)b)),
+                                  _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + size - 16)), _mm_loadu_si128((const __m128i*)(b + size - 16))));
+        return _mm_movemask_epi8(x) == 0xffff;
+    }
+
+    bool result = true;
+    ali_usize i = 0;
+    for (; i + 128 <= size; i += 128) {
+        __m256i eq = _mm256_and_si256(
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i))),
+                             _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i + 32)), _mm256_loadu_si256((const __m256i*)(b + i + 32)))),
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i + 64)), _mm256_loadu_si256((const __m256i*)(b + i + 64))),
+                             _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i + 96)), _mm256_loadu_si256((const __m256i*)(b + i + 96)))));
+        if ((ali_u32)_mm256_movemask_epi8(eq) != 0xffffffff) ali_return_defer(false);
+    }
+    for (; i + 32 <= size; i += 32) {
+        __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+        if ((ali_u32)_mm256_movemask_epi8(eq) != 0xffffffff) ali_return_defer(false);
+    }
+    if (i < size) {
+        __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + size - 32)), _mm256_loadu_si256((const __m256i*)(b + size - 32)));
+        result = (ali_u32)_mm256_movemask_epi8(eq) == 0xffffffff;
+    }
+
+defer:
+    _mm256_zeroupper();
+    return result;
+}
+
+__attribute__((target("avx2")))
+ali_isize ali__find_byte_avx2(const ali_u8* data, ali_usize size, ali_u8 byte) {
+    if (size < 16) return ali__find_byte_short(data, size, byte);
+    if (size < 32) {
+        __m128i needle = _mm_set1_epi8(byte);
+        ali_u32 mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)data), needle)) |
+                       _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + size - 16)), needle)) << (size - 16);
+        return mask != 0 ? __builtin_ctz(mask) : -1;
+    }
+
+    __m256i needle = _mm256_set1_epi8(byte);
+    ali_isize result = -1;
+    ali_usize i = 0;
+    for (; i + 128 <= size; i += 128) {
+        __m256i m0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i)), needle);
+        __m256i m1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i + 32)), needle);
+        __m256i m2 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i + 64)), needle);
+        __m256i m3 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i + 96)), needle);
+        if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(m0, m1), _mm256_or_si256(m2, m3))) == 0) continue;
+
+        ali_u64 mask = (ali_u32)_mm256_movemask_epi8(m0) | (ali_u64)(ali_u32)_mm256_movemask_epi8(m1) << 32;
+        if (mask != 0) ali_return_defer(i + __builtin_ctzll(mask));
+        mask = (ali_u32)_mm256_movemask_epi8(m2) | (ali_u64)(ali_u32)_mm256_movemask_epi8(m3) << 32;
+        ali_return_defer(i + 64 + __builtin_ctzll(mask));
+    }
+    for (; i + 32 <= size; i += 32) {
+        ali_u32 mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i)), needle));
+        if (mask != 0) ali_return_defer(i + __builtin_ctz(mask));
+    }
+    if (i < size) {
+        ali_u32 mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + size - 32)), needle));
+        if (mask != 0) result = size - 32 + __builtin_ctz(mask);
+    }
+
+defer:
+    _mm256_zeroupper();
+    return result;
+}
+
+// same as the sse2 one
+__attribute__((target("avx2")))
+ali_usize ali__count_byte_avx2(const ali_u8* data, ali_usize size, ali_u8 byte) {
+    __m256i needle = _mm256_set1_epi8(byte);
+    __m256i zero = _mm256_setzero_si256();
+    ali_usize count = 0;
+    ali_usize i = 0;
+    while (i + 64 <= size) {
+        __m256i lanes0 = zero;
+        __m256i lanes1 = zero;
+        for (ali_usize n = 0; n < 255 && i + 64 <= size; ++n, i += 64) {
+            lanes0 = _mm256_sub_epi8(lanes0, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i)), needle));
+            lanes1 = _mm256_sub_epi8(lanes1, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i + 32)), needle));
+        }
+        __m256i sums = _mm256_add_epi64(_mm256_sad_epu8(lanes0, zero), _mm256_sad_epu8(lanes1, zero));
+        __m128i halves = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+        count += (ali_usize)_mm_cvtsi128_si32(halves) + (ali_usize)_mm_cvtsi128_si32(_mm_srli_si128(halves, 8));
+    }
+    // at most 63 bytes left, a 16 byte step at a time can't overflow a lane
+    __m128i lanes = _mm_setzero_si128();
+    for (; i + 16 <= size; i += 16) {
+        lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i)), _mm256_castsi256_si128(needle)));
+    }
+    __m128i sums = _mm_sad_epu8(lanes, _mm_setzero_si128());
+    count += (ali_usize)_mm_cvtsi128_si32(sums) + (ali_usize)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+
+    _mm256_zeroupper();
+    return count + ali__count_byte_scalar(data + i, size - i, byte);
+}
+
+// __builtin_cpu_supports only tests a bit the runtime filled in at startup
+#define ali__simd_dispatch(name, ...) \
+    (__builtin_cpu_supports("avx2") ? name##_avx2(__VA_ARGS__) : \
+     __builtin_cpu_supports("sse2") ? name##_sse2(__VA_ARGS__) : name##_scalar(__VA_ARGS__))
+#else
+#define ali__simd_dispatch(name, ...) name##_scalar(__VA_ARGS__)
+#endif // ALI__SIMD_X86
+
+bool ali_mem_eq(const void* a, const void* b, ali_usize size) {
+    // not worth dispatching
+    if (size < 16) return ali__mem_eq_scalar(a, b, size);
+    return ali__simd_dispatch(ali__mem_eq, a, b, size);
+}
+
+ali_u64 ali_monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ali_u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline ali_u64 ali__hash_mix(ali_u64 a, ali_u64 b) {
+    __uint128_t r = (__uint128_t)a * b;
+    return (ali_u64)r ^ (ali_u64)(r >> 64);
+}
+
+static inline ali_u64 ali__hash_read64(const ali_u8* p) {
+    ali_u64 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+ali_u64 ali_hash_bytes(const void* data, ali_usize size, ali_u64 seed) {
+    const ali_u64 k0 = 0xa0761d6478bd642full;
+    const ali_u64 k1 = 0xe7037ed1a0b428dbull;
+    const ali_u64 k2 = 0x8ebc6af09c88c6e3ull;
+
+    const ali_u8* p = data;
+    ali_u64 h = ali__hash_mix(seed ^ k0, size ^ k1);
+    while (size >= 16) {
+        h = ali__hash_mix(ali__hash_read64(p) ^ k1, ali__hash_read64(p + 8) ^ h);
+        p += 16;
+        size -= 16;
+    }
+    if (size >= 8) {
+        h = ali__hash_mix(ali__hash_read64(p) ^ k1, h ^ k2);
+        p += 8;
+        size -= 8;
+    }
+    if (size > 0) {
+        ali_u64 tail = 0;
+        memcpy(&tail, p, size);
+        h = ali__hash_mix(tail ^ k2, h ^ k1);
+    }
+    return ali__hash_mix(h ^ k0, h ^ k2);
+}
+
+char* ali__cstr_dup(const char* cstr) {
+    ali_usize len = strlen(cstr);
+    char* copy = ali_alloc_ex(ali_libc_allocator, len + 1);
+    memcpy(copy, cstr, len + 1);
+    return copy;
+}
+
+char* ali__sv_dup(Ali_Sv sv) {
+    char* copy = ali_alloc_ex(ali_libc_allocator, sv.len + 1);
+    if (sv.len > 0) memcpy(copy, sv.start, sv.len);
+    copy[sv.len] = 0;
+    return copy;
+}
+
+bool ali__read_entire_file(const char* path, Ali_Sb* sb) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) return false;
+
+    char chunk[4096];
+    ali_usize n = 0;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        ali_da_append_many(sb, chunk, n);
+    }
+
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
 char* ali_text_format(char* buffer, ali_usize buffer_size, const char* fmt, ...) {
     va_list args;
     va_start(args, fmt);
@@ -711,55 +1597,38 @@ void ali_ensure_allocator_is_valid(Ali_Allocator* allocator) {
     }
 }
 
-static char buffer[ALI_TEMPBUF_SIZE];
-static ali_usize buffer_size = 0;
-
-ali_usize ali_tstamp(void) {
-    return buffer_size;
-}
-
-void ali_trewind(ali_usize stamp) {
-    buffer_size = stamp;
-}
-
-char* ali_tsprintf(const char* fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    int n = vsnprintf(NULL, 0, fmt, args);
-    va_end(args);
-
-    char* ptr = buffer + buffer_size;
-
-    va_start(args, fmt);
-    int n_ = vsnprintf(buffer + buffer_size, n + 1, fmt, args);
-    ali_unused(n_);
-    va_end(args);
-
-    ali_assert(buffer_size + n < ALI_TEMPBUF_SIZE);
-    buffer_size += n;
-
-    return ptr;
-}
+// bytes to skip at ptr to get to an address aligned to alignment (a power of two)
+#define ali__align_padding(ptr, alignment) ((ali_usize)(-(uintptr_t)(ptr) & ((alignment) - 1)))
 
 void* ali__arena_allocator(Ali_Allocator_Action action, void* old_pointer, ali_usize old_size, ali_usize size, ali_usize alignment, Ali_Location loc, void* user) {
     ali_unused(loc);
     Ali_Arena* arena = user;
+    if (alignment == 0) alignment = 1;
+    ali_assert((alignment & (alignment - 1)) == 0);
+
     switch (action) {
         case ALI_ALLOC: {
-            ali_assert(arena->size + size < arena->capacity);
-            arena->size += arena->size % alignment;
-            ali_assert(arena->size + size < arena->capacity);
-            void* ptr = arena->data + arena->size;
-            arena->size += size;
+            ali_usize start = arena->size + ali__align_padding(arena->data + arena->size, alignment);
+            ali_assert(start + size <= arena->capacity);
+            void* ptr = arena->data + start;
+            arena->size = start + size;
             return ptr;
         } break;
         case ALI_REALLOC: {
-            ali_assert(arena->size + size < arena->capacity);
-            arena->size += arena->size % alignment;
-            ali_assert(arena->size + size < arena->capacity);
-            void* ptr = arena->data + arena->size;
-            arena->size += size;
-            memcpy(ptr, old_pointer, old_size);
+            ali_u8* old = old_pointer;
+            // the last allocation can just grow (or shrink)
+            if (old != NULL && old + old_size == arena->data + arena->size && ali__align_padding(old, alignment) == 0) {
+                ali_usize start = old - arena->data;
+                ali_assert(start + size <= arena->capacity);
+                arena->size = start + size;
+                return old;
+            }
+
+            ali_usize start = arena->size + ali__align_padding(arena->data + arena->size, alignment);
+            ali_assert(start + size <= arena->capacity);
+            void* ptr = arena->data + start;
+            arena->size = start + size;
+            if (old != NULL) memcpy(ptr, old, old_size < size ? old_size : size);
             return ptr;
         } break;
         case ALI_FREE: {
@@ -767,6 +1636,7 @@ void* ali__arena_allocator(Ali_Allocator_Action action, void* old_pointer, ali_u
         } break;
         case ALI_FREEALL: {
             free(arena->data);
+            arena->data = NULL;
             arena->size = 0;
             arena->capacity = 0;
             return NULL;
@@ -791,90 +1661,134 @@ Ali_Allocator ali_arena_allocator(Ali_Arena* arena) {
     };
 }
 
+// a mark of an empty arena has a NULL target
 Ali_Arena_Mark ali_dynamic_arena_mark(Ali_Dynamic_Arena* arena) {
     return (Ali_Arena_Mark) {
         .target = arena->end,
-        .size = arena->end->size,
+        .size = arena->end != NULL ? arena->end->size : 0,
     };
 }
 
+void ali__dynamic_arena_trim(Ali_Dynamic_Arena* arena) {
+    if (arena->max_retained == 0 || arena->end == NULL) return;
+
+    ali_usize retained = 0;
+    for (Ali_Arena_Chunk* chunk = arena->start; chunk != arena->end->next; chunk = chunk->next) {
+        retained += chunk->capacity;
+    }
+
+    Ali_Arena_Chunk* prev = arena->end;
+    while (prev->next != NULL) {
+        Ali_Arena_Chunk* chunk = prev->next;
+        if (retained + chunk->capacity <= arena->max_retained) {
+            retained += chunk->capacity;
+            prev = chunk;
+        } else {
+            prev->next = chunk->next;
+            free(chunk);
+        }
+    }
+}
+
 void ali_dynamic_arena_rollback(Ali_Dynamic_Arena* arena, Ali_Arena_Mark mark) {
+    if (arena->start == NULL) return;
+    if (mark.target == NULL) {
+        mark.target = arena->start;
+        mark.size = 0;
+    }
+
     arena->end = mark.target;
     mark.target->size = mark.size;
     Ali_Arena_Chunk* current = mark.target->next;
     for (; current != NULL; current = current->next) {
         current->size = 0;
     }
+    ali__dynamic_arena_trim(arena);
+}
+
+void ali_dynamic_arena_reset(Ali_Dynamic_Arena* arena) {
+    ali_dynamic_arena_rollback(arena, (Ali_Arena_Mark) {0});
+}
+
+Ali_Dynamic_Arena_Stats ali_dynamic_arena_stats(Ali_Dynamic_Arena* arena) {
+    Ali_Dynamic_Arena_Stats stats = {0};
+    for (Ali_Arena_Chunk* chunk = arena->start; chunk != NULL; chunk = chunk->next) {
+        stats.chunks++;
+        stats.used += chunk->size;
+        stats.reserved += chunk->capacity;
+    }
+    return stats;
+}
+
+Ali_Arena_Chunk* ali__arena_chunk_new(ali_usize capacity, ali_usize size) {
+    while (capacity < size) { capacity *= 2; }
+
+    Ali_Arena_Chunk* new_chunk = malloc(sizeof(*new_chunk) + capacity);
+    ali_assert(new_chunk != NULL);
+    new_chunk->size = 0;
+    new_chunk->next = NULL;
+    new_chunk->capacity = capacity;
+    return new_chunk;
+}
+
+void* ali__dynamic_arena_alloc(Ali_Dynamic_Arena* arena, ali_usize size, ali_usize alignment) {
+    if (arena->end == NULL) {
+        ali_assert(arena->start == NULL);
+        arena->start = ali__arena_chunk_new(ALI_ARENA_CHUNK_INIT_CAPACITY, size + alignment - 1);
+        arena->end = arena->start;
+    }
+
+    Ali_Arena_Chunk* end = arena->end;
+    ali_usize start = end->size + ali__align_padding(end->data + end->size, alignment);
+    if (start + size > end->capacity) {
+        // the padding is at most alignment - 1 in an empty chunk
+        ali_usize needed = size + alignment - 1;
+
+        // chunks left over from a rollback come first, the ones too small for this are of no use anymore
+        while (end->next != NULL && end->next->capacity < needed) {
+            Ali_Arena_Chunk* small = end->next;
+            end->next = small->next;
+            free(small);
+        }
+        if (end->next == NULL) end->next = ali__arena_chunk_new(end->capacity, needed);
+
+        end = end->next;
+        end->size = 0;
+        arena->end = end;
+        start = ali__align_padding(end->data, alignment);
+    }
+
+    void* ptr = end->data + start;
+    end->size = start + size;
+    return ptr;
 }
 
 void* ali__dynamic_arena_function(Ali_Allocator_Action action, void* old_pointer, ali_usize old_size, ali_usize size, ali_usize alignment, Ali_Location loc, void* user) {
     ali_unused(loc);
     Ali_Dynamic_Arena* arena = user;
+    if (alignment == 0) alignment = 1;
+    ali_assert((alignment & (alignment - 1)) == 0);
+
     switch (action) {
             case ALI_ALLOC: {
-                if (arena->end == NULL) {
-                    ali_assert(arena->start == NULL);
-
-                    ali_usize capacity = ALI_ARENA_CHUNK_INIT_CAPACITY;
-                    while (capacity < size) { capacity *= 2; }
-
-                    Ali_Arena_Chunk* new_chunk = malloc(sizeof(*new_chunk) + capacity);
-                    ali_assert(new_chunk != NULL);
-                    new_chunk->size = 0;
-                    new_chunk->next = NULL;
-                    new_chunk->capacity = capacity;
-                    arena->start = new_chunk;
-                    arena->end = new_chunk;
-                }
-
-                arena->end->size += (arena->end->size % alignment);
-                if (arena->end->size + size > arena->end->capacity) {
-                    ali_usize capacity = arena->end->capacity;
-                    while (capacity < size) { capacity *= 2; }
-
-                    Ali_Arena_Chunk* new_chunk = malloc(sizeof(*new_chunk) + capacity);
-                    ali_assert(new_chunk != NULL);
-                    new_chunk->size = 0;
-                    new_chunk->next = NULL;
-                    new_chunk->capacity = capacity;
-                    arena->end->next = new_chunk;
-                    arena->end = new_chunk;
-                }
-
-                void* ptr = arena->end->data + arena->end->size;
-                arena->end->size += size;
-
-                return ptr;
+                return ali__dynamic_arena_alloc(arena, size, alignment);
             } break;
             case ALI_REALLOC: {
-                if (arena->end == NULL) {
-                    ali_assert(arena->start == NULL);
-                    Ali_Arena_Chunk* new_chunk = malloc(sizeof(*new_chunk));
-                    ali_assert(new_chunk != NULL);
-                    new_chunk->size = 0;
-                    new_chunk->next = NULL;
-                    new_chunk->capacity = arena->end->capacity;
-                    while (new_chunk->capacity < size) { new_chunk->capacity *= 2; }
-                    arena->end->next = new_chunk;
-                    arena->start = new_chunk;
-                    arena->end = new_chunk;
+                ali_u8* old = old_pointer;
+                Ali_Arena_Chunk* end = arena->end;
+                // the last allocation can grow (or shrink) as long as it fits in its chunk
+                if (old != NULL && end != NULL && old + old_size == end->data + end->size && ali__align_padding(old, alignment) == 0) {
+                    ali_usize start = old - end->data;
+                    if (start + size <= end->capacity) {
+                        end->size = start + size;
+                        return old;
+                    }
+                    // doesn't fit, but at least its space can go to whatever comes next
+                    end->size = start;
                 }
 
-                arena->end->size += (arena->end->size % alignment);
-                if (arena->end->size + size > arena->end->capacity) {
-                    Ali_Arena_Chunk* new_chunk = malloc(sizeof(*new_chunk));
-                    new_chunk->size = 0;
-                    new_chunk->next = NULL;
-                    new_chunk->capacity = arena->end->capacity;
-                    while (new_chunk->capacity < size) { new_chunk->capacity *= 2; }
-                    arena->end->next = new_chunk;
-                    arena->end = new_chunk;
-                }
-
-                void* ptr = arena->end->data + size;
-                arena->end->size += size;
-                memcpy(ptr, old_pointer, old_size);
-
+                void* ptr = ali__dynamic_arena_alloc(arena, size, alignment);
+                if (old != NULL) memmove(ptr, old, old_size < size ? old_size : size);
                 return ptr;
             } break;
             case ALI_FREE: {
@@ -902,792 +1816,3526 @@ Ali_Allocator ali_dynamic_arena_allocator(Ali_Dynamic_Arena* arena) {
     };
 }
 
-ali_static_assert(LOG_COUNT_ == 4);
-const char* ali_loglevel_to_str[LOG_COUNT_] = {
-    [LOG_DEBUG] = "DEBUG",
-    [LOG_INFO]= "INFO",
-    [LOG_WARN]= "WARN",
-    [LOG_ERROR] = "ERROR",
-};
+static _Thread_local Ali_Dynamic_Arena ali__scratch_arenas[ALI_SCRATCH_COUNT];
+static _Thread_local bool ali__scratch_arenas_ready = false;
 
-const char* ali_loglevel_color[LOG_COUNT_] = {
-    [LOG_DEBUG] = "\x1B[33m",
-    [LOG_INFO]= "\x1B[0m",
-    [LOG_WARN]= "\x1B[93m",
-    [LOG_ERROR] = "\x1B[91m",
-};
+#ifndef _WIN32
+static pthread_key_t ali__scratch_key;
+static pthread_once_t ali__scratch_key_once = PTHREAD_ONCE_INIT;
+
+// frees the scratch arenas of a thread when it exits
+void ali__scratch_arenas_free(void* user) {
+    Ali_Dynamic_Arena* arenas = user;
+    for (ali_usize i = 0; i < ALI_SCRATCH_COUNT; ++i) {
+        ali_freeall_ex(ali_dynamic_arena_allocator(&arenas[i]));
+    }
+}
 
-void ali__console_function(Ali_Log_Level level, const char* msg, void* user, Ali_Log_Opts opts, Ali_Location loc) {
-    ali_unused(user);
-    ali_unused(loc);
+void ali__scratch_key_create(void) {
+    pthread_key_create(&ali__scratch_key, ali__scratch_arenas_free);
+}
+#endif // _WIN32
 
-    time_t now = time(NULL);
-    bool terminal_color = opts & ALI_LOG_OPT_TERMCOLOR != 0;
+Ali_Dynamic_Arena* ali__scratch_arenas_get(void) {
+    if (!ali__scratch_arenas_ready) {
+        for (ali_usize i = 0; i < ALI_SCRATCH_COUNT; ++i) {
+            ali__scratch_arenas[i].max_retained = ALI_SCRATCH_MAX_RETAINED;
+        }
+#ifndef _WIN32
+        pthread_once(&ali__scratch_key_once, ali__scratch_key_create);
+        pthread_setspecific(ali__scratch_key, ali__scratch_arenas);
+#endif // _WIN32
+        ali__scratch_arenas_ready = true;
+    }
+    return ali__scratch_arenas;
+}
 
-    if (opts & ALI_LOG_OPT_LEVEL) {
-        if (terminal_color) {
-            fputs(ali_loglevel_color[level], stderr);
-            fprintf(stderr, "[%s]", ali_loglevel_to_str[level]);
-            fprintf(stderr, "\x1B[0m");
-            fprintf(stderr, " ");
-        } else {
-            fprintf(stderr, "[%s] ", ali_loglevel_to_str[level]);
+Ali_Scratch ali_scratch_begin(Ali_Dynamic_Arena** conflicts, ali_usize conflict_count) {
+    Ali_Dynamic_Arena* arenas = ali__scratch_arenas_get();
+    for (ali_usize i = 0; i < ALI_SCRATCH_COUNT; ++i) {
+        bool conflicting = false;
+        for (ali_usize j = 0; j < conflict_count && !conflicting; ++j) {
+            conflicting = conflicts[j] == &arenas[i];
         }
+        if (conflicting) continue;
+
+        return (Ali_Scratch) {
+            .arena = &arenas[i],
+            .mark = ali_dynamic_arena_mark(&arenas[i]),
+        };
     }
 
-    if (opts & ALI_LOG_OPT_TIME) {
-        char buffer[4096] = {0};
-        const char* DATE_FORMAT = "%Y %m. %d.";
-        strftime(buffer, sizeof(buffer), DATE_FORMAT, localtime(&now));
-        fprintf(stderr, "[%s] ", buffer);
+    ali_assertf(false, "All %d scratch arenas are in conflicts", ALI_SCRATCH_COUNT);
+    ali_unreachable();
+}
+
+void ali_scratch_end(Ali_Scratch scratch) {
+    ali_dynamic_arena_rollback(scratch.arena, scratch.mark);
+}
+
+Ali_Arena_Mark ali_tstamp(void) {
+    return ali_dynamic_arena_mark(&ali__scratch_arenas_get()[0]);
+}
+
+void ali_trewind(Ali_Arena_Mark stamp) {
+    ali_dynamic_arena_rollback(&ali__scratch_arenas_get()[0], stamp);
+}
+
+char* ali_tsprintf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    char* ptr = ali_alloc_aligned_ex(ali_dynamic_arena_allocator(&ali__scratch_arenas_get()[0]), n + 1, 1);
+
+    va_start(args, fmt);
+    vsnprintf(ptr, n + 1, fmt, args);
+    va_end(args);
+
+    return ptr;
+}
+
+#define ali__pool_slab_of(ptr) ((Ali_Pool_Slab*)((uintptr_t)(ptr) & ~(uintptr_t)(ALI_POOL_SLAB_SIZE - 1)))
+
+ali_usize ali__pool_class_of(ali_usize size) {
+    if (size <= ALI_POOL_MIN_BLOCK) return 0;
+    return 64 - __builtin_clzll(size - 1) - 4;
+}
+
+Ali_Pool_Slab* ali__pool_slab_new(Ali_Pool_Allocator* pool, ali_usize size, ali_usize block_size) {
+    size = (size + ALI_POOL_SLAB_SIZE - 1) & ~(ali_usize)(ALI_POOL_SLAB_SIZE - 1);
+    Ali_Pool_Slab* slab = aligned_alloc(ALI_POOL_SLAB_SIZE, size);
+    if (slab == NULL) return NULL;
+
+    slab->size = size;
+    slab->block_size = block_size;
+    slab->prev = NULL;
+    slab->next = pool->slabs;
+    if (pool->slabs != NULL) pool->slabs->prev = slab;
+    pool->slabs = slab;
+    return slab;
+}
+
+void* ali__pool_alloc(Ali_Pool_Allocator* pool, ali_usize size, ali_usize alignment) {
+    if (size < alignment) size = alignment;
+
+    if (size > ALI_POOL_MAX_BLOCK) {
+        // the block starts right after the header, so the header is still in the first ALI_POOL_SLAB_SIZE bytes
+        ali_usize offset = sizeof(Ali_Pool_Slab) < ALI_POOL_MIN_BLOCK ? ALI_POOL_MIN_BLOCK : sizeof(Ali_Pool_Slab);
+        if (offset < alignment) offset = alignment;
+        ali_assert(offset < ALI_POOL_SLAB_SIZE);
+
+        Ali_Pool_Slab* slab = ali__pool_slab_new(pool, offset + size, 0);
+        if (slab == NULL) return NULL;
+        return (ali_u8*)slab + offset;
     }
 
-    if (opts & ALI_LOG_OPT_DATE) {
-        char buffer[4096] = {0};
-        const char* TIME_FORMAT = "%H";
-        strftime(buffer, sizeof(buffer), TIME_FORMAT, localtime(&now));
-        fprintf(stderr, "[%s] ", buffer);
+    ali_usize class = ali__pool_class_of(size);
+    ali_usize block_size = (ali_usize)ALI_POOL_MIN_BLOCK << class;
+
+    void* block = pool->free_lists[class];
+    if (block != NULL) {
+        pool->free_lists[class] = *(void**)block;
+        return block;
     }
 
-    if (opts & ALI_LOG_OPT_LOC) {
-        fprintf(stderr, "[%s:%d(%s)] ", loc.file, loc.line, loc.function);
+    if (pool->bump[class] == pool->bump_end[class]) {
+        Ali_Pool_Slab* slab = ali__pool_slab_new(pool, ALI_POOL_SLAB_SIZE, block_size);
+        if (slab == NULL) return NULL;
+
+        // the first block size aligned offset after the header, so every block is aligned to its size
+        ali_usize offset = (sizeof(Ali_Pool_Slab) + block_size - 1) & ~(block_size - 1);
+        pool->bump[class] = (ali_u8*)slab + offset;
+        pool->bump_end[class] = (ali_u8*)slab + ALI_POOL_SLAB_SIZE;
     }
 
-    fprintf(stderr, "%s\n", msg);
+    block = pool->bump[class];
+    pool->bump[class] += block_size;
+    return block;
 }
 
-void ali__file_function(Ali_Log_Level level, const char* msg, void* user, Ali_Log_Opts opts, Ali_Location loc) {
+void ali__pool_free(Ali_Pool_Allocator* pool, void* ptr) {
+    if (ptr == NULL) return;
+
+    Ali_Pool_Slab* slab = ali__pool_slab_of(ptr);
+    if (slab->block_size == 0) {
+        if (slab->prev != NULL) slab->prev->next = slab->next;
+        else pool->slabs = slab->next;
+        if (slab->next != NULL) slab->next->prev = slab->prev;
+        free(slab);
+        return;
+    }
+
+    ali_usize class = ali__pool_class_of(slab->block_size);
+    *(void**)ptr = pool->free_lists[class];
+    pool->free_lists[class] = ptr;
+}
+
+// how many bytes can be used at ptr
+ali_usize ali__pool_block_size(void* ptr) {
+    Ali_Pool_Slab* slab = ali__pool_slab_of(ptr);
+    if (slab->block_size != 0) return slab->block_size;
+    return slab->size - ((ali_u8*)ptr - (ali_u8*)slab);
+}
+
+void* ali__pool_allocator_function(Ali_Allocator_Action action, void* old_pointer, ali_usize old_size, ali_usize size, ali_usize alignment, Ali_Location loc, void* user) {
     ali_unused(loc);
+    ali_unused(old_size);
+    Ali_Pool_Allocator* pool = user;
+    if (alignment == 0) alignment = 1;
+    ali_assert((alignment & (alignment - 1)) == 0);
 
-    time_t now = time(NULL);
-    static char buffer[4069] = {0};
-    FILE* f = user;
+    switch (action) {
+        case ALI_ALLOC: {
+            return ali__pool_alloc(pool, size, alignment);
+        } break;
+        case ALI_REALLOC: {
+            if (old_pointer == NULL) return ali__pool_alloc(pool, size, alignment);
 
-    if (opts & ALI_LOG_OPT_LEVEL) {
-        fprintf(f, "[%s] ", ali_loglevel_to_str[level]);
-    }
+            ali_usize available = ali__pool_block_size(old_pointer);
+            if (size <= available && ((uintptr_t)old_pointer & (alignment - 1)) == 0) return old_pointer;
 
-    if (opts & ALI_LOG_OPT_TIME) {
-        char buffer[4096] = {0};
-        const char* DATE_FORMAT = "%Y %m. %d.";
-        strftime(buffer, sizeof(buffer), DATE_FORMAT, localtime(&now));
-        fprintf(f, "[%s] ", buffer);
+            void* ptr = ali__pool_alloc(pool, size, alignment);
+            if (ptr == NULL) return NULL;
+            memcpy(ptr, old_pointer, available < size ? available : size);
+            ali__pool_free(pool, old_pointer);
+            return ptr;
+        } break;
+        case ALI_FREE: {
+            ali__pool_free(pool, old_pointer);
+            return NULL;
+        } break;
+        case ALI_FREEALL: {
+            Ali_Pool_Slab* slab = pool->slabs;
+            while (slab != NULL) {
+                Ali_Pool_Slab* next = slab->next;
+                free(slab);
+                slab = next;
+            }
+            memset(pool, 0, sizeof(*pool));
+            return NULL;
+        } break;
     }
 
-    if (opts & ALI_LOG_OPT_DATE) {
-        char buffer[4096] = {0};
-        const char* TIME_FORMAT = "%H";
-        strftime(buffer, sizeof(buffer), TIME_FORMAT, localtime(&now));
-        fprintf(f, "[%s] ", buffer);
+    ali_unreachable();
+}
+
+Ali_Allocator ali_pool_allocator(Ali_Pool_Allocator* pool) {
+    return (Ali_Allocator) {
+        .allocator_function = ali__pool_allocator_function,
+        .user = pool,
+    };
+}
+
+Ali_Atomic_Chunk* ali__atomic_chunk_new(ali_usize size) {
+    ali_usize capacity = ALI_ATOMIC_ARENA_CHUNK_SIZE;
+    while (capacity < size) { capacity *= 2; }
+
+    Ali_Atomic_Chunk* chunk = aligned_alloc(16, sizeof(*chunk) + capacity);
+    ali_assert(chunk != NULL);
+    chunk->size = 0;
+    chunk->capacity = capacity;
+    chunk->next = NULL;
+    return chunk;
+}
+
+// installs new_chunk at *where unless some other thread got there first
+Ali_Atomic_Chunk* ali__atomic_chunk_install(Ali_Atomic_Chunk** where, Ali_Atomic_Chunk* new_chunk) {
+    Ali_Atomic_Chunk* expected = NULL;
+    if (__atomic_compare_exchange_n(where, &expected, new_chunk, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return new_chunk;
     }
+    free(new_chunk);
+    return expected;
+}
 
-    if (opts & ALI_LOG_OPT_LOC) {
-        fprintf(f, "[%s:%d(%s)] ", loc.file, loc.line, loc.function);
+void* ali__atomic_arena_alloc(Ali_Atomic_Arena* arena, ali_usize size, ali_usize alignment) {
+    // everything is handed out in multiples of 16 bytes, so only bigger alignments need padding
+    ali_usize request = (size + 15) & ~(ali_usize)15;
+    if (alignment > 16) request += alignment - 16;
+
+    Ali_Atomic_Chunk* chunk = __atomic_load_n(&arena->current, __ATOMIC_ACQUIRE);
+    if (chunk == NULL) {
+        Ali_Atomic_Chunk* first = __atomic_load_n(&arena->first, __ATOMIC_ACQUIRE);
+        if (first == NULL) first = ali__atomic_chunk_install(&arena->first, ali__atomic_chunk_new(request));
+        Ali_Atomic_Chunk* expected = NULL;
+        __atomic_compare_exchange_n(&arena->current, &expected, first, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        chunk = __atomic_load_n(&arena->current, __ATOMIC_ACQUIRE);
     }
 
-    fprintf(f, "%s\n", msg);
+    for (;;) {
+        ali_usize offset = __atomic_fetch_add(&chunk->size, request, __ATOMIC_RELAXED);
+        if (offset + request <= chunk->capacity) {
+            ali_u8* ptr = chunk->data + offset;
+            return ptr + ali__align_padding(ptr, alignment);
+        }
+
+        // full, move on to the next chunk (installing it if nobody has yet)
+        Ali_Atomic_Chunk* next = __atomic_load_n(&chunk->next, __ATOMIC_ACQUIRE);
+        if (next == NULL) next = ali__atomic_chunk_install(&chunk->next, ali__atomic_chunk_new(request));
+        Ali_Atomic_Chunk* expected = chunk;
+        __atomic_compare_exchange_n(&arena->current, &expected, next, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        chunk = next;
+    }
 }
 
-Ali_Logger ali_console_logger(void) {
-    return (Ali_Logger) {
-        .level = LOG_INFO,
-        .function = ali__console_function,
-        .user = NULL,
-        .opts = ALI_LOG_OPTS_DEFAULT,
+// a mark of an empty arena has a NULL target
+Ali_Atomic_Arena_Mark ali_atomic_arena_mark(Ali_Atomic_Arena* arena) {
+    Ali_Atomic_Chunk* current = arena->current;
+    return (Ali_Atomic_Arena_Mark) {
+        .target = current,
+        .size = current == NULL ? 0 : current->size < current->capacity ? current->size : current->capacity,
     };
 }
 
-Ali_Logger ali_file_logger(FILE* f) {
-    return (Ali_Logger) {
-        .level = LOG_INFO,
-        .function = ali__file_function,
-        .user = f,
-        .opts = ALI_LOG_OPTS_DEFAULT,
-    };
+void ali_atomic_arena_rollback(Ali_Atomic_Arena* arena, Ali_Atomic_Arena_Mark mark) {
+    if (arena->first == NULL) return;
+    if (mark.target == NULL) {
+        mark.target = arena->first;
+        mark.size = 0;
+    }
+
+    arena->current = mark.target;
+    mark.target->size = mark.size;
+    for (Ali_Atomic_Chunk* chunk = mark.target->next; chunk != NULL; chunk = chunk->next) {
+        chunk->size = 0;
+    }
 }
 
-Ali_Logger ali_global_logger = {
-    .level = LOG_INFO,
-    .function = ali__console_function,
-    .user = NULL,
-    .opts = ALI_LOG_OPTS_DEFAULT,
-};
+void ali_atomic_arena_reset(Ali_Atomic_Arena* arena) {
+    ali_atomic_arena_rollback(arena, (Ali_Atomic_Arena_Mark) {0});
+}
 
-void ali_log_log_ex(Ali_Logger logger, Ali_Log_Level level, Ali_Location loc, const char* fmt, ...) {
-    if (level < logger.level) return;
-    ali_assert(logger.function != NULL);
+void* ali__atomic_arena_function(Ali_Allocator_Action action, void* old_pointer, ali_usize old_size, ali_usize size, ali_usize alignment, Ali_Location loc, void* user) {
+    ali_unused(loc);
+    Ali_Atomic_Arena* arena = user;
+    if (alignment == 0) alignment = 1;
+    ali_assert((alignment & (alignment - 1)) == 0);
 
-    va_list args;
-    va_start(args, fmt);
+    switch (action) {
+        case ALI_ALLOC: {
+            return ali__atomic_arena_alloc(arena, size, alignment);
+        } break;
+        case ALI_REALLOC: {
+            void* ptr = ali__atomic_arena_alloc(arena, size, alignment);
+            if (old_pointer != NULL) memcpy(ptr, old_pointer, old_size < size ? old_size : size);
+            return ptr;
+        } break;
+        case ALI_FREE: {
+            return NULL;
+        } break;
+        case ALI_FREEALL: {
+            Ali_Atomic_Chunk* chunk = arena->first;
+            while (chunk != NULL) {
+                Ali_Atomic_Chunk* next = chunk->next;
+                free(chunk);
+                chunk = next;
+            }
+            arena->first = NULL;
+            arena->current = NULL;
+            return NULL;
+        } break;
+    }
 
-    const char* msg = ali_static_vsprintf(fmt, args);
-    logger.function(level, msg, logger.user, logger.opts, loc);
+    ali_unreachable();
+}
 
-    va_end(args);
+Ali_Allocator ali_atomic_arena_allocator(Ali_Atomic_Arena* arena) {
+    return (Ali_Allocator) {
+        .allocator_function = ali__atomic_arena_function,
+        .user = arena,
+    };
 }
 
-typedef enum {
-    FLAG_BOOL,
-    FLAG_STRING,
-    FLAG_U64,
-    FLAG_F64,
-}Ali_Flag_Type;
+#ifndef _WIN32
+bool ali_vm_arena_init(Ali_Vm_Arena* arena, ali_usize reserve) {
+    return ali_vm_arena_init_ex(arena, reserve, (Ali_Vm_Arena_Options) {0});
+}
 
-typedef struct {
-    Ali_Flag_Options options;
-    Ali_Flag_Type type;
-    Ali_Flag_As as;
-}Ali_Flag;
+// reserves size bytes aligned to alignment by reserving more and unmapping what sticks out
+void* ali__vm_reserve_aligned(ali_usize size, ali_usize alignment) {
+    ali_u8* base = mmap(NULL, size + alignment, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) return NULL;
 
-typedef struct {
-    const char* program;
+    ali_usize head = ali__align_padding(base, alignment);
+    if (head > 0) munmap(base, head);
+    munmap(base + head + size, alignment - head);
+    return base + head;
+}
 
-    #ifndef ALI_FLAG_MAX_COUNT
-    #define ALI_FLAG_MAX_COUNT (1 << 8)
-    #endif // ALI_FLAG_MAX_COUNT
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif // MPOL_BIND
 
-    Ali_Flag flags_array[ALI_FLAG_MAX_COUNT];
-    ali_usize flags_count;
-}Ali_Flag_State;
+void ali__vm_arena_bind_numa_node(Ali_Vm_Arena* arena, int node) {
+#ifdef SYS_mbind
+    unsigned long mask[1024 / (8 * sizeof(unsigned long))] = {0};
+    if (node < 0 || (ali_usize)node >= 8 * sizeof(mask) - 1) {
+        ali_log_warn("There is no numa node %d, not binding the arena", node);
+        return;
+    }
+    mask[node / (8 * sizeof(unsigned long))] |= 1ul << (node % (8 * sizeof(unsigned long)));
+    if (syscall(SYS_mbind, arena->base, arena->reserved, MPOL_BIND, mask, 8 * sizeof(mask), 0) < 0) {
+        ali_log_warn("Couldn't bind the arena to numa node %d: %s", node, ali_libc_get_error());
+    }
+#else // SYS_mbind
+    ali_unused(arena);
+    ali_log_warn("Can't bind memory to numa node %d on this system", node);
+#endif // SYS_mbind
+}
 
-Ali_Flag_State flag_state = {0};
+bool ali_vm_arena_init_ex(Ali_Vm_Arena* arena, ali_usize reserve, Ali_Vm_Arena_Options options) {
+    memset(arena, 0, sizeof(*arena));
+    arena->commit_size = ALI_VM_ARENA_COMMIT_SIZE;
+    ali_usize page_size = sysconf(_SC_PAGESIZE);
+    if (options.pages != ALI_PAGES_NORMAL) {
+        // huge pages are only used for huge page aligned ranges with the same protection
+        page_size = ALI_HUGE_PAGE_SIZE;
+        if (arena->commit_size < ALI_HUGE_PAGE_SIZE) arena->commit_size = ALI_HUGE_PAGE_SIZE;
+    }
+    reserve = (reserve + page_size - 1) & ~(page_size - 1);
+
+    void* base = NULL;
+    if (options.pages == ALI_PAGES_HUGETLB) {
+        // without MAP_NORESERVE, so running out of huge pages fails here and not with a SIGBUS later
+        base = mmap(NULL, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base == MAP_FAILED) {
+            ali_log_warn("Couldn't reserve %zu bytes of huge pages, using transparent huge pages: %s", reserve, ali_libc_get_error());
+            base = NULL;
+            options.pages = ALI_PAGES_TRANSPARENT_HUGE;
+        }
+    }
+    if (base == NULL) {
+        base = ali__vm_reserve_aligned(reserve, page_size);
+        if (base == NULL) {
+            ali_log_error("Couldn't reserve %zu bytes: %s", reserve, ali_libc_get_error());
+            return false;
+        }
+    }
 
-void ali__flags_push(Ali_Flag flag) {
-    ali_assert(flag_state.flags_count < ALI_FLAG_MAX_COUNT);
-    flag_state.flags_array[flag_state.flags_count++] = flag;
+    arena->base = base;
+    arena->reserved = reserve;
+    if (options.pages == ALI_PAGES_TRANSPARENT_HUGE && madvise(base, reserve, MADV_HUGEPAGE) < 0) {
+        ali_log_warn("Couldn't ask for transparent huge pages: %s", ali_libc_get_error());
+    }
+    if (options.bind_numa_node) ali__vm_arena_bind_numa_node(arena, options.numa_node);
+    return true;
 }
 
-ali__flag_def(ali_flag_option, bool, FLAG_BOOL);
-ali__flag_def(ali_flag_u64, ali_u64, FLAG_U64);
-ali__flag_def(ali_flag_f64, double, FLAG_F64);
-ali__flag_def(ali_flag_string, char*, FLAG_STRING);
+bool ali__vm_arena_commit(Ali_Vm_Arena* arena, ali_usize size) {
+    if (size <= arena->committed) return true;
+    if (size > arena->reserved) {
+        ali_log_error("Vm arena ran out of its %zu reserved bytes", arena->reserved);
+        return false;
+    }
 
-void ali_flag_reset(void) {
-    flag_state.flags_count = 0;
+    ali_usize commit = (size + arena->commit_size - 1) & ~(arena->commit_size - 1);
+    if (commit > arena->reserved) commit = arena->reserved;
+    if (mprotect(arena->base + arena->committed, commit - arena->committed, PROT_READ | PROT_WRITE) < 0) {
+        ali_log_error("Couldn't commit memory: %s", ali_libc_get_error());
+        return false;
+    }
+    arena->committed = commit;
+    return true;
 }
 
-void ali_flag_print_usage(FILE* f) {
-    fprintf(f, "Usage: %s ", flag_state.program);
-    {
-        ali_isize pos = 0;
-        for (ali_usize i = 0; i < flag_state.flags_count; ++i) {
-            Ali_Flag* flag = &flag_state.flags_array[i];
+void ali_vm_arena_reset(Ali_Vm_Arena* arena) {
+    arena->size = 0;
 
-            if (flag->options.pos >= 0 && flag->options.pos == pos) {
-                fprintf(f, "<%s> ", flag->options.name);
-                pos++;
-            }
+    ali_usize keep = (arena->high_water_mark + arena->commit_size - 1) & ~(arena->commit_size - 1);
+    if (arena->committed <= keep) return;
+
+    // the pages are zero again the next time they are committed
+    ali_u8* start = arena->base + keep;
+    ali_usize len = arena->committed - keep;
+    if (madvise(start, len, MADV_DONTNEED) == 0) {
+        mprotect(start, len, PROT_NONE);
+    } else {
+        // older kernels can't MADV_DONTNEED hugetlb pages, a fresh mapping over them drops them too
+        // (and the range is back to normal pages)
+        void* remapped = mmap(start, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+        if (remapped == MAP_FAILED) {
+            ali_log_warn("Couldn't give %zu bytes of the vm arena back: %s", len, ali_libc_get_error());
+            mprotect(start, len, PROT_NONE);
         }
     }
-    fprintf(f, "[OPTIONS]\n");
-    fprintf(f, "Options:\n");
-    for (ali_usize i = 0; i < flag_state.flags_count; ++i) {
-        Ali_Flag* flag = &flag_state.flags_array[i];
-        char* prefix = strlen(flag->options.name) > 1 ? "--" : "-";
-        fprintf(f, "    %s%s", prefix, flag->options.name);
-        if (flag->options.aliases_count) {
-            fprintf(f, ", also: ");
-            for (ali_usize i = 0; i < flag->options.aliases_count; ++i) {
-                if (i != 0) fprintf(f, ", ");
-                char* prefix = strlen(flag->options.aliases[i]) > 1 ? "--" : "-";
-                fprintf(f, "`%s%s`", prefix, flag->options.aliases[i]);
-            }
+    arena->committed = keep;
+}
+
+void ali_vm_arena_destroy(Ali_Vm_Arena* arena) {
+    if (arena->base != NULL) munmap(arena->base, arena->reserved);
+    memset(arena, 0, sizeof(*arena));
+}
+
+void* ali__vm_arena_alloc(Ali_Vm_Arena* arena, ali_usize size, ali_usize alignment) {
+    ali_usize start = (arena->size + alignment - 1) & ~(alignment - 1);
+    if (start + size < start || !ali__vm_arena_commit(arena, start + size)) return NULL;
+    arena->size = start + size;
+    return arena->base + start;
+}
+
+void* ali__vm_arena_function(Ali_Allocator_Action action, void* old_pointer, ali_usize old_size, ali_usize size, ali_usize alignment, Ali_Location loc, void* user) {
+    ali_unused(loc);
+    Ali_Vm_Arena* arena = user;
+    if (alignment == 0) alignment = 1;
+    ali_assert((alignment & (alignment - 1)) == 0);
+
+    switch (action) {
+        case ALI_ALLOC: {
+            return ali__vm_arena_alloc(arena, size, alignment);
+        } break;
+        case ALI_REALLOC: {
+            ali_u8* old = old_pointer;
+            // the last allocation can just grow (or shrink)
+            if (old != NULL && old + old_size == arena->base + arena->size && ((uintptr_t)old & (alignment - 1)) == 0) {
+                ali_usize start = old - arena->base;
+                if (!ali__vm_arena_commit(arena, start + size)) return NULL;
+                arena->size = start + size;
+                return old;
+            }
+
+            void* ptr = ali__vm_arena_alloc(arena, size, alignment);
+            if (ptr != NULL && old != NULL) memcpy(ptr, old, old_size < size ? old_size : size);
+            return ptr;
+        } break;
+        case ALI_FREE: {
+            return NULL;
+        } break;
+        case ALI_FREEALL: {
+            ali_vm_arena_reset(arena);
+            return NULL;
+        } break;
+    }
+
+    ali_unreachable();
+}
+
+Ali_Allocator ali_vm_arena_allocator(Ali_Vm_Arena* arena) {
+    return (Ali_Allocator) {
+        .allocator_function = ali__vm_arena_function,
+        .user = arena,
+    };
+}
+
+#define ALI__THREAD_CACHE_LARGE ALI_THREAD_CACHE_CLASS_COUNT
+
+// sits right before every block
+typedef struct {
+    ali_u32 class;
+    ali_u32 offset; // from the start of what the backing allocator returned, for large blocks
+    ali_u64 size; // usable bytes
+}Ali__Thread_Cache_Header;
+ali_static_assert(sizeof(Ali__Thread_Cache_Header) == 16);
+
+typedef struct {
+    Ali_Thread_Cache_Allocator* tc;
+    Ali_Magazine* loaded[ALI_THREAD_CACHE_CLASS_COUNT];
+}Ali__Thread_Cache;
+
+// lock has to be held
+Ali_Magazine* ali__thread_cache_empty_magazine(Ali_Thread_Cache_Allocator* tc) {
+    if (tc->empty.count > 0) return tc->empty.items[--tc->empty.count];
+    Ali_Magazine* magazine = ali_alloc_aligned_ex(tc->backing, sizeof(Ali_Magazine), 16);
+    if (magazine != NULL) magazine->count = 0;
+    return magazine;
+}
+
+// lock has to be held
+void ali__thread_cache_return_magazine(Ali_Thread_Cache_Allocator* tc, ali_usize class, Ali_Magazine* magazine) {
+    if (magazine == NULL) return;
+    if (magazine->count > 0) ali_da_append(&tc->magazines[class], magazine);
+    else ali_da_append(&tc->empty, magazine);
+}
+
+// lock has to be held
+void ali__thread_cache_carve(Ali_Thread_Cache_Allocator* tc, ali_usize class, Ali_Magazine* magazine, ali_usize count) {
+    ali_usize block_size = sizeof(Ali__Thread_Cache_Header) + ((ali_usize)16 << class);
+    while (magazine->count < count) {
+        if (tc->bump == NULL || (ali_usize)(tc->bump_end - tc->bump) < block_size) {
+            ali_u8* chunk = ali_alloc_aligned_ex(tc->backing, ALI_THREAD_CACHE_CHUNK_SIZE, 16);
+            if (chunk == NULL) return;
+            ali_da_append(&tc->chunks, (void*)chunk);
+            tc->bump = chunk;
+            tc->bump_end = chunk + ALI_THREAD_CACHE_CHUNK_SIZE;
+        }
+
+        Ali__Thread_Cache_Header* header = (Ali__Thread_Cache_Header*)tc->bump;
+        header->class = class;
+        header->offset = 0;
+        header->size = (ali_usize)16 << class;
+        tc->bump += block_size;
+        magazine->blocks[magazine->count++] = header + 1;
+    }
+}
+
+void ali__thread_cache_flush(void* user) {
+    Ali__Thread_Cache* cache = user;
+    Ali_Thread_Cache_Allocator* tc = cache->tc;
+
+    pthread_mutex_lock(&tc->lock);
+    for (ali_usize class = 0; class < ALI_THREAD_CACHE_CLASS_COUNT; ++class) {
+        ali__thread_cache_return_magazine(tc, class, cache->loaded[class]);
+    }
+    ali_free_ex(tc->backing, cache);
+    pthread_mutex_unlock(&tc->lock);
+}
+
+Ali__Thread_Cache* ali__thread_cache_get(Ali_Thread_Cache_Allocator* tc) {
+    Ali__Thread_Cache* cache = pthread_getspecific(tc->key);
+    if (cache != NULL) return cache;
+
+    pthread_mutex_lock(&tc->lock);
+    cache = ali_alloc_aligned_ex(tc->backing, sizeof(*cache), 16);
+    pthread_mutex_unlock(&tc->lock);
+    if (cache == NULL) return NULL;
+
+    memset(cache, 0, sizeof(*cache));
+    cache->tc = tc;
+    pthread_setspecific(tc->key, cache);
+    return cache;
+}
+
+void* ali__thread_cache_alloc_large(Ali_Thread_Cache_Allocator* tc, ali_usize size, ali_usize alignment) {
+    if (alignment < 16) alignment = 16;
+    ali_usize padding = sizeof(Ali__Thread_Cache_Header) + alignment - 16;
+
+    pthread_mutex_lock(&tc->lock);
+    ali_u8* base = ali_alloc_aligned_ex(tc->backing, padding + size, 16);
+    pthread_mutex_unlock(&tc->lock);
+    if (base == NULL) return NULL;
+
+    ali_u8* ptr = (ali_u8*)(((uintptr_t)base + sizeof(Ali__Thread_Cache_Header) + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    Ali__Thread_Cache_Header* header = (Ali__Thread_Cache_Header*)ptr - 1;
+    header->class = ALI__THREAD_CACHE_LARGE;
+    header->offset = ptr - base;
+    header->size = size;
+    return ptr;
+}
+
+void* ali__thread_cache_alloc(Ali_Thread_Cache_Allocator* tc, ali_usize size, ali_usize alignment) {
+    if (size > ALI_THREAD_CACHE_MAX_BLOCK || alignment > 16) return ali__thread_cache_alloc_large(tc, size, alignment);
+
+    Ali__Thread_Cache* cache = ali__thread_cache_get(tc);
+    if (cache == NULL) return NULL;
+
+    ali_usize class = size <= 16 ? 0 : 64 - __builtin_clzll(size - 1) - 4;
+    Ali_Magazine* magazine = cache->loaded[class];
+    if (magazine != NULL && magazine->count > 0) return magazine->blocks[--magazine->count];
+
+    pthread_mutex_lock(&tc->lock);
+    if (tc->magazines[class].count > 0) {
+        ali__thread_cache_return_magazine(tc, class, magazine);
+        magazine = tc->magazines[class].items[--tc->magazines[class].count];
+    } else {
+        if (magazine == NULL) magazine = ali__thread_cache_empty_magazine(tc);
+        // leave room for the blocks this thread frees
+        if (magazine != NULL) ali__thread_cache_carve(tc, class, magazine, ALI_MAGAZINE_SIZE / 2);
+    }
+    pthread_mutex_unlock(&tc->lock);
+
+    cache->loaded[class] = magazine;
+    if (magazine == NULL || magazine->count == 0) return NULL;
+    return magazine->blocks[--magazine->count];
+}
+
+void ali__thread_cache_free(Ali_Thread_Cache_Allocator* tc, void* ptr) {
+    if (ptr == NULL) return;
+
+    Ali__Thread_Cache_Header* header = (Ali__Thread_Cache_Header*)ptr - 1;
+    if (header->class == ALI__THREAD_CACHE_LARGE) {
+        pthread_mutex_lock(&tc->lock);
+        ali_free_ex(tc->backing, (ali_u8*)ptr - header->offset);
+        pthread_mutex_unlock(&tc->lock);
+        return;
+    }
+
+    Ali__Thread_Cache* cache = ali__thread_cache_get(tc);
+    ali_assert(cache != NULL);
+
+    ali_usize class = header->class;
+    Ali_Magazine* magazine = cache->loaded[class];
+    if (magazine == NULL || magazine->count == ALI_MAGAZINE_SIZE) {
+        pthread_mutex_lock(&tc->lock);
+        ali__thread_cache_return_magazine(tc, class, magazine);
+        magazine = ali__thread_cache_empty_magazine(tc);
+        pthread_mutex_unlock(&tc->lock);
+        ali_assert(magazine != NULL);
+        cache->loaded[class] = magazine;
+    }
+    magazine->blocks[magazine->count++] = ptr;
+}
+
+void* ali__thread_cache_allocator_function(Ali_Allocator_Action action, void* old_pointer, ali_usize old_size, ali_usize size, ali_usize alignment, Ali_Location loc, void* user) {
+    ali_unused(loc);
+    ali_unused(old_size);
+    Ali_Thread_Cache_Allocator* tc = user;
+
+    switch (action) {
+        case ALI_ALLOC: {
+            return ali__thread_cache_alloc(tc, size, alignment);
+        } break;
+        case ALI_REALLOC: {
+            if (old_pointer == NULL) return ali__thread_cache_alloc(tc, size, alignment);
+
+            Ali__Thread_Cache_Header* header = (Ali__Thread_Cache_Header*)old_pointer - 1;
+            if (size <= header->size && ((uintptr_t)old_pointer & (alignment - 1)) == 0) return old_pointer;
+
+            void* ptr = ali__thread_cache_alloc(tc, size, alignment);
+            if (ptr == NULL) return NULL;
+            memcpy(ptr, old_pointer, header->size < size ? header->size : size);
+            ali__thread_cache_free(tc, old_pointer);
+            return ptr;
+        } break;
+        case ALI_FREE: {
+            ali__thread_cache_free(tc, old_pointer);
+            return NULL;
+        } break;
+        case ALI_FREEALL: {
+            return NULL;
+        } break;
+    }
+
+    ali_unreachable();
+}
+
+bool ali_thread_cache_allocator_init(Ali_Thread_Cache_Allocator* tc, Ali_Allocator backing) {
+    memset(tc, 0, sizeof(*tc));
+    ali_ensure_allocator_is_valid(&backing);
+    tc->backing = backing;
+
+    int err = pthread_mutex_init(&tc->lock, NULL);
+    if (err != 0) {
+        ali_log_error("Couldn't create mutex: %s", strerror(err));
+        return false;
+    }
+    err = pthread_key_create(&tc->key, ali__thread_cache_flush);
+    if (err != 0) {
+        ali_log_error("Couldn't create thread key: %s", strerror(err));
+        pthread_mutex_destroy(&tc->lock);
+        return false;
+    }
+    return true;
+}
+
+void ali_thread_cache_allocator_destroy(Ali_Thread_Cache_Allocator* tc) {
+    Ali__Thread_Cache* cache = pthread_getspecific(tc->key);
+    if (cache != NULL) ali__thread_cache_flush(cache);
+    pthread_key_delete(tc->key);
+
+    for (ali_usize class = 0; class < ALI_THREAD_CACHE_CLASS_COUNT; ++class) {
+        ali_da_foreach(&tc->magazines[class], Ali_Magazine*, magazine) {
+            ali_free_ex(tc->backing, *magazine);
+        }
+        ali_da_free(&tc->magazines[class]);
+    }
+    ali_da_foreach(&tc->empty, Ali_Magazine*, magazine) {
+        ali_free_ex(tc->backing, *magazine);
+    }
+    ali_da_free(&tc->empty);
+    ali_da_foreach(&tc->chunks, void*, chunk) {
+        ali_free_ex(tc->backing, *chunk);
+    }
+    ali_da_free(&tc->chunks);
+
+    pthread_mutex_destroy(&tc->lock);
+}
+
+Ali_Allocator ali_thread_cache_allocator(Ali_Thread_Cache_Allocator* tc) {
+    return (Ali_Allocator) {
+        .allocator_function = ali__thread_cache_allocator_function,
+        .user = tc,
+    };
+}
+#endif // _WIN32
+
+Ali_Tracking_Allocator ali_track_allocator(Ali_Allocator allocator) {
+    ali_ensure_allocator_is_valid(&allocator);
+    return (Ali_Tracking_Allocator) {
+        .backing = allocator,
+        .rng = 0x9E3779B97F4A7C15ull,
+    };
+}
+
+ali_usize ali__tracked_slot(Ali_Tracking_Allocator* t, void* ptr) {
+    return (((uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15ull) >> 32 & (t->allocations_capacity - 1);
+}
+
+// hashes the fields one by one, the padding of a location is garbage
+ali_u64 ali__tracked_loc_hash(Ali_Location loc) {
+    ali_u64 key[3] = { (uintptr_t)loc.file, (uintptr_t)loc.function, loc.line };
+    return ali_hash_bytes(key, sizeof(key), 0);
+}
+
+void ali__tracked_insert(Ali_Tracking_Allocator* t, Ali_Tracked_Allocation allocation);
+
+void ali__tracked_grow(Ali_Tracking_Allocator* t) {
+    Ali_Tracked_Allocation* old = t->allocations;
+    ali_usize old_capacity = t->allocations_capacity;
+
+    t->allocations_capacity = old_capacity == 0 ? 256 : old_capacity * 2;
+    t->allocations = calloc(t->allocations_capacity, sizeof(*t->allocations));
+    ali_assert(t->allocations != NULL);
+    t->allocations_count = 0;
+    for (ali_usize i = 0; i < old_capacity; ++i) {
+        if (old[i].ptr != NULL) ali__tracked_insert(t, old[i]);
+    }
+    free(old);
+}
+
+void ali__tracked_insert(Ali_Tracking_Allocator* t, Ali_Tracked_Allocation allocation) {
+    // at most half full, so probes stay short
+    if ((t->allocations_count + 1) * 2 > t->allocations_capacity) ali__tracked_grow(t);
+
+    ali_usize i = ali__tracked_slot(t, allocation.ptr);
+    while (t->allocations[i].ptr != NULL) i = (i + 1) & (t->allocations_capacity - 1);
+    t->allocations[i] = allocation;
+    t->allocations_count++;
+}
+
+// removes ptr from the table, returns false if it wasn't tracked
+bool ali__tracked_remove(Ali_Tracking_Allocator* t, void* ptr, Ali_Tracked_Allocation* removed) {
+    if (t->allocations_count == 0 || ptr == NULL) return false;
+
+    ali_usize mask = t->allocations_capacity - 1;
+    ali_usize i = ali__tracked_slot(t, ptr);
+    while (t->allocations[i].ptr != ptr) {
+        if (t->allocations[i].ptr == NULL) return false;
+        i = (i + 1) & mask;
+    }
+    *removed = t->allocations[i];
+    t->allocations_count--;
+
+    // shift back whatever follows in the same run, so no tombstones are needed
+    for (ali_usize j = (i + 1) & mask; t->allocations[j].ptr != NULL; j = (j + 1) & mask) {
+        ali_usize home = ali__tracked_slot(t, t->allocations[j].ptr);
+        // j can move to i if its home isn't in (i, j]
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            t->allocations[i] = t->allocations[j];
+            i = j;
+        }
+    }
+    t->allocations[i].ptr = NULL;
+    return true;
+}
+
+ali_u32 ali__tracked_site(Ali_Tracking_Allocator* t, Ali_Location loc) {
+    if ((t->sites.count + 1) * 2 > t->site_slots_capacity) {
+        free(t->site_slots);
+        t->site_slots_capacity = t->site_slots_capacity == 0 ? 64 : t->site_slots_capacity * 2;
+        t->site_slots = calloc(t->site_slots_capacity, sizeof(*t->site_slots));
+        ali_assert(t->site_slots != NULL);
+        for (ali_usize s = 0; s < t->sites.count; ++s) {
+            Ali_Location site_loc = t->sites.items[s].loc;
+            ali_usize i = ali__tracked_loc_hash(site_loc) & (t->site_slots_capacity - 1);
+            while (t->site_slots[i] != 0) i = (i + 1) & (t->site_slots_capacity - 1);
+            t->site_slots[i] = s + 1;
+        }
+    }
+
+    // the strings of a location are literals, so comparing pointers is enough
+    ali_usize i = ali__tracked_loc_hash(loc) & (t->site_slots_capacity - 1);
+    while (t->site_slots[i] != 0) {
+        Ali_Location* site_loc = &t->sites.items[t->site_slots[i] - 1].loc;
+        if (site_loc->file == loc.file && site_loc->line == loc.line && site_loc->function == loc.function) {
+            return t->site_slots[i] - 1;
+        }
+        i = (i + 1) & (t->site_slots_capacity - 1);
+    }
+
+    Ali_Allocation_Site site = { .loc = loc };
+    ali_da_append(&t->sites, site);
+    t->site_slots[i] = t->sites.count;
+    return t->sites.count - 1;
+}
+
+void ali__tracked_alloc(Ali_Tracking_Allocator* t, void* ptr, ali_usize size, Ali_Location loc) {
+    if (ptr == NULL) return;
+
+    ali_usize weight = size;
+    if (t->sample_rate > 1 && size < t->sample_rate) {
+        t->rng ^= t->rng << 13;
+        t->rng ^= t->rng >> 7;
+        t->rng ^= t->rng << 17;
+        if (t->rng % t->sample_rate >= size) return;
+        weight = t->sample_rate;
+    }
+
+    ali_u32 site_index = ali__tracked_site(t, loc);
+    Ali_Allocation_Site* site = &t->sites.items[site_index];
+    site->live_bytes += weight;
+    site->live_allocs += 1;
+    site->total_bytes += weight;
+    site->total_allocs += 1;
+    if (site->live_bytes > site->peak_bytes) site->peak_bytes = site->live_bytes;
+    t->live_bytes += weight;
+    if (t->live_bytes > t->peak_bytes) t->peak_bytes = t->live_bytes;
+
+    ali__tracked_insert(t, (Ali_Tracked_Allocation) { .ptr = ptr, .weight = weight, .site = site_index });
+}
+
+void ali__tracked_free(Ali_Tracking_Allocator* t, void* ptr) {
+    Ali_Tracked_Allocation allocation;
+    if (!ali__tracked_remove(t, ptr, &allocation)) return;
+
+    Ali_Allocation_Site* site = &t->sites.items[allocation.site];
+    site->live_bytes -= allocation.weight;
+    site->live_allocs -= 1;
+    t->live_bytes -= allocation.weight;
+}
+
+void* ali__tracking_allocator_function(Ali_Allocator_Action action, void* old_pointer, ali_usize old_size, ali_usize size, ali_usize alignment, Ali_Location loc, void* user) {
+    Ali_Tracking_Allocator* t = user;
+    Ali_Allocator backing = t->backing;
+
+    switch (action) {
+        case ALI_ALLOC: {
+            void* ptr = backing.allocator_function(action, old_pointer, old_size, size, alignment, loc, backing.user);
+            ali__tracked_alloc(t, ptr, size, loc);
+            return ptr;
+        } break;
+        case ALI_REALLOC: {
+            void* ptr = backing.allocator_function(action, old_pointer, old_size, size, alignment, loc, backing.user);
+            if (ptr == NULL && size > 0) return NULL;
+            // the new block belongs to whoever reallocated it
+            ali__tracked_free(t, old_pointer);
+            ali__tracked_alloc(t, ptr, size, loc);
+            return ptr;
+        } break;
+        case ALI_FREE: {
+            ali__tracked_free(t, old_pointer);
+            return backing.allocator_function(action, old_pointer, old_size, size, alignment, loc, backing.user);
+        } break;
+        case ALI_FREEALL: {
+            if (t->allocations != NULL) memset(t->allocations, 0, t->allocations_capacity * sizeof(*t->allocations));
+            t->allocations_count = 0;
+            ali_da_foreach(&t->sites, Ali_Allocation_Site, site) {
+                site->live_bytes = 0;
+                site->live_allocs = 0;
+            }
+            t->live_bytes = 0;
+            return backing.allocator_function(action, old_pointer, old_size, size, alignment, loc, backing.user);
+        } break;
+    }
+
+    ali_unreachable();
+}
+
+Ali_Allocator ali_tracking_allocator(Ali_Tracking_Allocator* allocator) {
+    return (Ali_Allocator) {
+        .allocator_function = ali__tracking_allocator_function,
+        .user = allocator,
+    };
+}
+
+static Ali_Allocation_Site* ali__tracked_sites_to_sort;
+
+int ali__tracked_site_compare(const void* a, const void* b) {
+    ali_usize a_bytes = ali__tracked_sites_to_sort[*(const ali_u32*)a].live_bytes;
+    ali_usize b_bytes = ali__tracked_sites_to_sort[*(const ali_u32*)b].live_bytes;
+    return (a_bytes < b_bytes) - (a_bytes > b_bytes);
+}
+
+void ali_log_tracked(Ali_Tracking_Allocator* allocator, ali_usize top_n) {
+    ali_usize count = allocator->sites.count;
+    if (top_n == 0 || top_n > count) top_n = count;
+
+    ali_u32* order = malloc(sizeof(*order) * (count > 0 ? count : 1));
+    ali_assert(order != NULL);
+    for (ali_usize i = 0; i < count; ++i) order[i] = i;
+    ali__tracked_sites_to_sort = allocator->sites.items;
+    qsort(order, count, sizeof(*order), ali__tracked_site_compare);
+
+    ali_log_info("[ALLOC] %zu bytes live, %zu bytes at peak, %zu call sites%s",
+                 allocator->live_bytes, allocator->peak_bytes, count,
+                 allocator->sample_rate > 1 ? " (sampled, sizes are estimates)" : "");
+    for (ali_usize i = 0; i < top_n; ++i) {
+        Ali_Allocation_Site* site = &allocator->sites.items[order[i]];
+        ali_log_info("[ALLOC] %10zu live (%zu allocs) %10zu peak %10zu total (%zu allocs) %s:%d (%s)",
+                     site->live_bytes, site->live_allocs, site->peak_bytes, site->total_bytes, site->total_allocs,
+                     site->loc.file, site->loc.line, site->loc.function);
+    }
+
+    free(order);
+}
+
+void ali_tracking_allocator_free(Ali_Tracking_Allocator* allocator) {
+    free(allocator->allocations);
+    free(allocator->site_slots);
+    ali_da_free(&allocator->sites);
+    *allocator = ali_track_allocator(allocator->backing);
+}
+
+ali_static_assert(LOG_COUNT_ == 4);
+const char* ali_loglevel_to_str[LOG_COUNT_] = {
+    [LOG_DEBUG] = "DEBUG",
+    [LOG_INFO]= "INFO",
+    [LOG_WARN]= "WARN",
+    [LOG_ERROR] = "ERROR",
+};
+
+const char* ali_loglevel_color[LOG_COUNT_] = {
+    [LOG_DEBUG] = "\x1B[33m",
+    [LOG_INFO]= "\x1B[0m",
+    [LOG_WARN]= "\x1B[93m",
+    [LOG_ERROR] = "\x1B[91m",
+};
+
+void ali__console_function(Ali_Log_Level level, const char* msg, void* user, Ali_Log_Opts opts, Ali_Location loc) {
+    ali_unused(user);
+    ali_unused(loc);
+
+    time_t now = time(NULL);
+    bool terminal_color = opts & ALI_LOG_OPT_TERMCOLOR != 0;
+
+    if (opts & ALI_LOG_OPT_LEVEL) {
+        if (terminal_color) {
+            fputs(ali_loglevel_color[level], stderr);
+            fprintf(stderr, "[%s]", ali_loglevel_to_str[level]);
+            fprintf(stderr, "\x1B[0m");
+            fprintf(stderr, " ");
+        } else {
+            fprintf(stderr, "[%s] ", ali_loglevel_to_str[level]);
+        }
+    }
+
+    if (opts & ALI_LOG_OPT_TIME) {
+        char buffer[4096] = {0};
+        const char* DATE_FORMAT = "%Y %m. %d.";
+        strftime(buffer, sizeof(buffer), DATE_FORMAT, localtime(&now));
+        fprintf(stderr, "[%s] ", buffer);
+    }
+
+    if (opts & ALI_LOG_OPT_DATE) {
+        char buffer[4096] = {0};
+        const char* TIME_FORMAT = "%H";
+        strftime(buffer, sizeof(buffer), TIME_FORMAT, localtime(&now));
+        fprintf(stderr, "[%s] ", buffer);
+    }
+
+    if (opts & ALI_LOG_OPT_LOC) {
+        fprintf(stderr, "[%s:%d(%s)] ", loc.file, loc.line, loc.function);
+    }
+
+    fprintf(stderr, "%s\n", msg);
+}
+
+void ali__file_function(Ali_Log_Level level, const char* msg, void* user, Ali_Log_Opts opts, Ali_Location loc) {
+    ali_unused(loc);
+
+    time_t now = time(NULL);
+    static char buffer[4069] = {0};
+    FILE* f = user;
+
+    if (opts & ALI_LOG_OPT_LEVEL) {
+        fprintf(f, "[%s] ", ali_loglevel_to_str[level]);
+    }
+
+    if (opts & ALI_LOG_OPT_TIME) {
+        char buffer[4096] = {0};
+        const char* DATE_FORMAT = "%Y %m. %d.";
+        strftime(buffer, sizeof(buffer), DATE_FORMAT, localtime(&now));
+        fprintf(f, "[%s] ", buffer);
+    }
+
+    if (opts & ALI_LOG_OPT_DATE) {
+        char buffer[4096] = {0};
+        const char* TIME_FORMAT = "%H";
+        strftime(buffer, sizeof(buffer), TIME_FORMAT, localtime(&now));
+        fprintf(f, "[%s] ", buffer);
+    }
+
+    if (opts & ALI_LOG_OPT_LOC) {
+        fprintf(f, "[%s:%d(%s)] ", loc.file, loc.line, loc.function);
+    }
+
+    fprintf(f, "%s\n", msg);
+}
+
+Ali_Logger ali_console_logger(void) {
+    return (Ali_Logger) {
+        .level = LOG_INFO,
+        .function = ali__console_function,
+        .user = NULL,
+        .opts = ALI_LOG_OPTS_DEFAULT,
+    };
+}
+
+Ali_Logger ali_file_logger(FILE* f) {
+    return (Ali_Logger) {
+        .level = LOG_INFO,
+        .function = ali__file_function,
+        .user = f,
+        .opts = ALI_LOG_OPTS_DEFAULT,
+    };
+}
+
+Ali_Logger ali_global_logger = {
+    .level = LOG_INFO,
+    .function = ali__console_function,
+    .user = NULL,
+    .opts = ALI_LOG_OPTS_DEFAULT,
+};
+
+void ali_log_log_ex(Ali_Logger logger, Ali_Log_Level level, Ali_Location loc, const char* fmt, ...) {
+    if (level < logger.level) return;
+    ali_assert(logger.function != NULL);
+
+    va_list args;
+    va_start(args, fmt);
+
+    const char* msg = ali_static_vsprintf(fmt, args);
+    logger.function(level, msg, logger.user, logger.opts, loc);
+
+    va_end(args);
+}
+
+typedef enum {
+    FLAG_BOOL,
+    FLAG_STRING,
+    FLAG_U64,
+    FLAG_F64,
+}Ali_Flag_Type;
+
+typedef struct {
+    Ali_Flag_Options options;
+    Ali_Flag_Type type;
+    Ali_Flag_As as;
+}Ali_Flag;
+
+typedef struct {
+    const char* program;
+
+    #ifndef ALI_FLAG_MAX_COUNT
+    #define ALI_FLAG_MAX_COUNT (1 << 8)
+    #endif // ALI_FLAG_MAX_COUNT
+
+    Ali_Flag flags_array[ALI_FLAG_MAX_COUNT];
+    ali_usize flags_count;
+}Ali_Flag_State;
+
+Ali_Flag_State flag_state = {0};
+
+void ali__flags_push(Ali_Flag flag) {
+    ali_assert(flag_state.flags_count < ALI_FLAG_MAX_COUNT);
+    flag_state.flags_array[flag_state.flags_count++] = flag;
+}
+
+ali__flag_def(ali_flag_option, bool, FLAG_BOOL);
+ali__flag_def(ali_flag_u64, ali_u64, FLAG_U64);
+ali__flag_def(ali_flag_f64, double, FLAG_F64);
+ali__flag_def(ali_flag_string, char*, FLAG_STRING);
+
+void ali_flag_reset(void) {
+    flag_state.flags_count = 0;
+}
+
+void ali_flag_print_usage(FILE* f) {
+    fprintf(f, "Usage: %s ", flag_state.program);
+    {
+        ali_isize pos = 0;
+        for (ali_usize i = 0; i < flag_state.flags_count; ++i) {
+            Ali_Flag* flag = &flag_state.flags_array[i];
+
+            if (flag->options.pos >= 0 && flag->options.pos == pos) {
+                fprintf(f, "<%s> ", flag->options.name);
+                pos++;
+            }
+        }
+    }
+    fprintf(f, "[OPTIONS]\n");
+    fprintf(f, "Options:\n");
+    for (ali_usize i = 0; i < flag_state.flags_count; ++i) {
+        Ali_Flag* flag = &flag_state.flags_array[i];
+        char* prefix = strlen(flag->options.name) > 1 ? "--" : "-";
+        fprintf(f, "    %s%s", prefix, flag->options.name);
+        if (flag->options.aliases_count) {
+            fprintf(f, ", also: ");
+            for (ali_usize i = 0; i < flag->options.aliases_count; ++i) {
+                if (i != 0) fprintf(f, ", ");
+                char* prefix = strlen(flag->options.aliases[i]) > 1 ? "--" : "-";
+                fprintf(f, "`%s%s`", prefix, flag->options.aliases[i]);
+            }
+        }
+        if (flag->options.description != NULL) {
+            fprintf(f, " (%s)", flag->options.description);
+        }
+        fprintf(f, "\n");
+    }
+    fprintf(f, "\n");
+}
+
+bool ali_flag_parse(int argc, char** argv) {
+    flag_state.program = ali_shift(argv, argc);
+
+    ali_isize pos = 0;
+    while (argc > 0) {
+        char* arg = ali_shift(argv, argc);
+        
+        if (*arg == '-' && *(arg + 1) == 0) goto pos_handling;
+        bool is_short = *arg == '-' && *(arg + 2) == 0;
+        bool is_long = *arg == '-' && *(arg + 1) == '-';
+        if (is_short || is_long) {
+            if (is_short) arg++;
+            else if (is_long) arg += 2;
+
+            bool found = false;
+            for (ali_usize i = 0; i < flag_state.flags_count; ++i) {
+                Ali_Flag* current_flag = &flag_state.flags_array[i];
+
+                bool match = false;
+                match |= strcmp(arg, current_flag->options.name) == 0;
+                for (ali_usize i = 0; !match && i < current_flag->options.aliases_count; ++i) {
+                    match |= strcmp(arg, current_flag->options.aliases[i]) == 0;
+                }
+
+                if (!match) continue;
+                found = true;
+
+                switch (current_flag->type) {
+                    case FLAG_BOOL: {
+                                        current_flag->as.option = true;
+                                    } break;
+                    case FLAG_STRING: {
+                                          char* arg_value = ali_shift(argv, argc);
+                                          current_flag->as.string = arg_value;
+                                      } break;
+                    case FLAG_U64: {
+                                       char* arg_value = ali_shift(argv, argc);
+                                       current_flag->as.u64 = atoll(arg_value);
+                                   } break;
+                    case FLAG_F64: {
+                                       char* arg_value = ali_shift(argv, argc);
+                                       current_flag->as.f64 = atof(arg_value);
+                                   } break;
+                }
+
+                break;
+            }
+
+            if (!found) {
+                ali_log_error("Couldn't parse args");
+                ali_flag_print_usage(stderr);
+                return false;
+            }
+        }
+
+pos_handling:
+        for (ali_usize i = 0; i < flag_state.flags_count; ++i) {
+            Ali_Flag* current_flag = &flag_state.flags_array[i];
+
+            if (current_flag->options.pos >= 0 && current_flag->options.pos == pos) {
+                switch (current_flag->type) {
+                    case FLAG_STRING: {
+                        current_flag->as.string = arg;
+                    } break;
+                    case FLAG_U64: {
+                        current_flag->as.u64 = atoll(arg);
+                    } break;
+                    case FLAG_F64: {
+                        current_flag->as.f64 = atof(arg);
+                    } break;
+                    case FLAG_BOOL: {}break;
+                }
+
+                pos++;
+            }
+        }
+    }
+
+    return true;
+}
+
+Ali_Slice ali_slice_slice(Ali_Slice slice, ali_usize start, ali_usize end) {
+    ali_assert(start < slice.count);
+    ali_assert(end <= slice.count);
+    ali_assert(start < end);
+
+    return (Ali_Slice) {
+        .data_size = slice.data_size,
+        .count = end - start,
+        .data = slice.data + (slice.data_size * start),
+    };
+}
+
+Ali_Slice ali_slice_to_byte_slice(Ali_Slice slice) {
+    return (Ali_Slice) {
+        .count = slice.count * slice.data_size,
+        .data = slice.data,
+        .data_size = 1,
+    };
+}
+
+void* ali_slice_get(Ali_Slice slice, ali_usize index) {
+    ali_assert(index < slice.count);
+    return slice.data + slice.data_size * index;
+}
+
+Ali_Sv ali_sb_to_sv(Ali_Sb* sb) {
+    return ali_sv_from_parts(sb->items, sb->count);
+}
+
+void ali_sb_sprintf(Ali_Sb* sb, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    ali_da_resize_for(sb, n);
+
+    va_start(args, fmt);
+    int n_ = vsnprintf(sb->items + sb->count, n + 1, fmt, args);
+    ali_unused(n_);
+    va_end(args);
+
+    sb->count += n;
+}
+
+char* ali_sb_to_cstr(Ali_Sb* sb, Ali_Allocator allocator) {
+    char* copy = ali_alloc_ex(allocator, sb->count + 1);
+    memcpy(copy, sb->items, sb->count);
+    copy[sb->count] = 0;
+    return copy;
+}
+
+Ali_Sv ali_sv_from_cstr(const char* cstr) {
+    Ali_Sv sv = {0};
+    sv.start = cstr;
+    sv.len = strlen(cstr);
+    return sv;
+}
+
+Ali_Sv ali_sv_from_parts(const char* start, ali_usize len) {
+    return (Ali_Sv) {
+        .start = start,
+        .len = len,
+    };
+}
+
+bool ali_sv_starts_with_prefix(Ali_Sv self, Ali_Sv prefix) {
+    if (self.len < prefix.len) return false;
+    return ali_mem_eq(self.start, prefix.start, prefix.len);
+}
+
+Ali_Sv ali_sv_strip_prefix(Ali_Sv self, Ali_Sv prefix) {
+    if (!ali_sv_starts_with_prefix(self, prefix)) return self;
+    self.len -= prefix.len; 
+    self.start += prefix.len; 
+    return self;
+}
+
+bool ali_sv_ends_with_suffix(Ali_Sv self, Ali_Sv suffix) {
+    if (self.len < suffix.len) return false;
+    return ali_mem_eq(self.start + self.len - suffix.len, suffix.start, suffix.len);
+}
+
+Ali_Sv ali_sv_strip_suffix(Ali_Sv self, Ali_Sv suffix) {
+    if (!ali_sv_ends_with_suffix(self, suffix)) return self;
+    self.len -= suffix.len;
+    return self;
+}
+
+bool ali_sv_eq(Ali_Sv a, Ali_Sv b) {
+    if (a.len != b.len) return false;
+    return ali_mem_eq(a.start, b.start, a.len);
+}
+
+ali_isize ali_sv_find_byte(Ali_Sv self, char byte) {
+    return ali__simd_dispatch(ali__find_byte, (const ali_u8*)self.start, self.len, (ali_u8)byte);
+}
+
+ali_isize ali_sv_find(Ali_Sv self, Ali_Sv needle) {
+    if (needle.len == 0) return 0;
+
+    // find the first byte, then check the rest
+    ali_usize i = 0;
+    while (i + needle.len <= self.len) {
+        ali_isize found = ali_sv_find_byte(ali_sv_from_parts(self.start + i, self.len - i - needle.len + 1), needle.start[0]);
+        if (found < 0) return -1;
+        i += found;
+        if (ali_mem_eq(self.start + i + 1, needle.start + 1, needle.len - 1)) return i;
+        i++;
+    }
+    return -1;
+}
+
+ali_usize ali_sv_count_byte(Ali_Sv self, char byte) {
+    return ali__simd_dispatch(ali__count_byte, (const ali_u8*)self.start, self.len, (ali_u8)byte);
+}
+
+Ali_Sv ali_sv_chop_by_delim(Ali_Sv* self, char delim) {
+    ali_isize i = ali_sv_find_byte(*self, delim);
+    if (i < 0) {
+        Ali_Sv chopped = *self;
+        self->start += self->len;
+        self->len = 0;
+        return chopped;
+    }
+
+    Ali_Sv chopped = ali_sv_from_parts(self->start, i);
+    self->start += i + 1;
+    self->len -= i + 1;
+    return chopped;
+}
+
+void ali_sv_split_by(Ali_Sv self, char delim, Ali_Svs* svs) {
+    ali_da_reserve(svs, ali_sv_count_byte(self, delim) + 1);
+    for (;;) {
+        ali_isize i = ali_sv_find_byte(self, delim);
+        if (i < 0) break;
+        ali_da_append(svs, ali_sv_from_parts(self.start, i));
+        self.start += i + 1;
+        self.len -= i + 1;
+    }
+    ali_da_append(svs, self);
+}
+
+bool ali_sv_chop_u64(Ali_Sv* self, int base, ali_u64* n) {
+    ali_assert(base == 10 || base == 16);
+    ali_u64 result = 0;
+    ali_usize i = 0;
+    for (; i < self->len; ++i) {
+        char c = self->start[i];
+        int digit = -1;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (base == 16 && c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (base == 16 && c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        if (digit < 0) break;
+        result = result * base + digit;
+    }
+    if (i == 0) return false;
+
+    self->start += i;
+    self->len -= i;
+    *n = result;
+    return true;
+}
+
+bool ali_sv_chop_i64(Ali_Sv* self, ali_i64* n) {
+    Ali_Sv rest = *self;
+    bool negative = ali_sv_starts_with_prefix(rest, SV("-"));
+    if (negative) rest = ali_sv_strip_prefix(rest, SV("-"));
+
+    ali_u64 magnitude = 0;
+    if (!ali_sv_chop_u64(&rest, 10, &magnitude)) return false;
+    *self = rest;
+    *n = negative ? -(ali_i64)magnitude : (ali_i64)magnitude;
+    return true;
+}
+
+bool ali_tokenizer_next(Ali_Tokenizer* tokenizer, char delim, Ali_Sv* token) {
+    if (tokenizer->rest.len == 0) return false;
+    *token = ali_sv_chop_by_delim(&tokenizer->rest, delim);
+    tokenizer->line++;
+    return true;
+}
+
+bool ali_tokenizer_next_line(Ali_Tokenizer* tokenizer, Ali_Sv* line) {
+    if (!ali_tokenizer_next(tokenizer, '\n', line)) return false;
+    *line = ali_sv_strip_suffix(*line, SV("\r"));
+    return true;
+}
+
+void ali_sb_render_cmd(Ali_Sb* sb, char** cmd, ali_usize cmd_count) {
+    for (ali_usize i = 0; i < cmd_count; ++i) {
+        if (i != 0) ali_da_append(sb, (char)' ');
+        if (strchr(cmd[i], ' ') == NULL) {
+            int len = strlen(cmd[i]);
+            ali_da_append_many(sb, cmd[i], len);
+        } else {
+            ali_sb_sprintf(sb, "'%s'", cmd[i]);
+        }
+    }
+}
+
+#define ALI__HM_EMPTY 0x80
+
+static inline ali_u64 ali__hm_hash(Ali_Sv key) {
+    return ali_hash_bytes(key.start, key.len, 0);
+}
+
+// bit i is set if group[i] == h2
+static inline ali_u32 ali__hm_match(const ali_u8* group, ali_u8 h2) {
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2)));
+#else
+    ali_u32 mask = 0;
+    for (ali_u32 i = 0; i < ALI_HM_GROUP; ++i) mask |= (ali_u32)(group[i] == h2) << i;
+    return mask;
+#endif // __SSE2__
+}
+
+// bit i is set if slot i of the group is empty (the only control byte with the high bit set)
+static inline ali_u32 ali__hm_match_empty(const ali_u8* group) {
+#ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#else
+    ali_u32 mask = 0;
+    for (ali_u32 i = 0; i < ALI_HM_GROUP; ++i) mask |= (ali_u32)(group[i] >> 7) << i;
+    return mask;
+#endif // __SSE2__
+}
+
+static inline void ali__hm_set_ctrl(Ali_Hm_Table* table, ali_usize slot, ali_u8 ctrl) {
+    table->ctrl[slot] = ctrl;
+    if (slot < ALI_HM_GROUP - 1) table->ctrl[table->capacity + slot] = ctrl;
+}
+
+// the slot of key, or if it isn't there the empty slot it would go in
+ali_usize ali__hm_probe(Ali_Hm_Table* table, Ali_Sv key, ali_u64 hash, bool* found) {
+    ali_usize mask = table->capacity - 1;
+    ali_u8 h2 = hash & 0x7f;
+    for (ali_usize pos = (hash >> 7) & mask;; pos = (pos + ALI_HM_GROUP) & mask) {
+        const ali_u8* group = table->ctrl + pos;
+        for (ali_u32 match = ali__hm_match(group, h2); match != 0; match &= match - 1) {
+            ali_usize slot = (pos + __builtin_ctz(match)) & mask;
+            if (ali_sv_eq(table->keys[slot], key)) {
+                *found = true;
+                return slot;
+            }
+        }
+
+        // with linear probing nothing that belongs here can be past an empty slot
+        ali_u32 empty = ali__hm_match_empty(group);
+        if (empty != 0) {
+            *found = false;
+            return (pos + __builtin_ctz(empty)) & mask;
+        }
+    }
+}
+
+void ali__hm_grow(Ali_Hm_Table* table, void** values, ali_usize value_size) {
+    Ali_Hm_Table new_table = {
+        .allocator = table->allocator,
+        .count = table->count,
+        .capacity = table->capacity == 0 ? ALI_HM_GROUP : table->capacity * 2,
+    };
+    new_table.ctrl = ali_alloc_aligned_ex(table->allocator, new_table.capacity + ALI_HM_GROUP - 1, 16);
+    new_table.keys = ali_alloc_aligned_ex(table->allocator, new_table.capacity * sizeof(Ali_Sv), 16);
+    ali_u8* new_values = ali_alloc_aligned_ex(table->allocator, new_table.capacity * value_size, 16);
+    ali_assert(new_table.ctrl != NULL && new_table.keys != NULL && new_values != NULL);
+    memset(new_table.ctrl, ALI__HM_EMPTY, new_table.capacity + ALI_HM_GROUP - 1);
+
+    for (ali_usize i = 0; i < table->capacity; ++i) {
+        if (table->ctrl[i] == ALI__HM_EMPTY) continue;
+
+        bool found = false;
+        ali_usize slot = ali__hm_probe(&new_table, table->keys[i], ali__hm_hash(table->keys[i]), &found);
+        ali__hm_set_ctrl(&new_table, slot, table->ctrl[i]);
+        new_table.keys[slot] = table->keys[i];
+        memcpy(new_values + slot * value_size, (ali_u8*)*values + i * value_size, value_size);
+    }
+
+    if (table->capacity > 0) {
+        ali_free_ex(table->allocator, table->ctrl);
+        ali_free_ex(table->allocator, table->keys);
+        ali_free_ex(table->allocator, *values);
+    }
+    *table = new_table;
+    *values = new_values;
+}
+
+void* ali__hm_find(Ali_Hm_Table* table, void* values, ali_usize value_size, Ali_Sv key) {
+    if (table->count == 0) return NULL;
+
+    bool found = false;
+    ali_usize slot = ali__hm_probe(table, key, ali__hm_hash(key), &found);
+    return found ? (ali_u8*)values + slot * value_size : NULL;
+}
+
+ali_usize ali__hm_insert(Ali_Hm_Table* table, void** values, ali_usize value_size, Ali_Sv key, bool* existed) {
+    ali_ensure_allocator_is_valid(&table->allocator);
+    // keep the load factor under 3/4
+    if ((table->count + 1) * 4 > table->capacity * 3) ali__hm_grow(table, values, value_size);
+
+    bool found = false;
+    ali_u64 hash = ali__hm_hash(key);
+    ali_usize slot = ali__hm_probe(table, key, hash, &found);
+    if (!found) {
+        ali__hm_set_ctrl(table, slot, hash & 0x7f);
+        table->keys[slot] = key;
+        memset((ali_u8*)*values + slot * value_size, 0, value_size);
+        table->count++;
+    }
+
+    if (existed != NULL) *existed = found;
+    return slot;
+}
+
+void* ali__hm_entry(Ali_Hm_Table* table, void** values, ali_usize value_size, Ali_Sv key, bool* existed) {
+    ali_usize slot = ali__hm_insert(table, values, value_size, key, existed);
+    return (ali_u8*)*values + slot * value_size;
+}
+
+bool ali__hm_remove(Ali_Hm_Table* table, void* values, ali_usize value_size, Ali_Sv key) {
+    if (table->count == 0) return false;
+
+    bool found = false;
+    ali_usize hole = ali__hm_probe(table, key, ali__hm_hash(key), &found);
+    if (!found) return false;
+
+    // shift back every key after the hole that may live in it
+    ali_usize mask = table->capacity - 1;
+    for (ali_usize slot = (hole + 1) & mask; table->ctrl[slot] != ALI__HM_EMPTY; slot = (slot + 1) & mask) {
+        ali_usize home = (ali__hm_hash(table->keys[slot]) >> 7) & mask;
+        if (((slot - home) & mask) < ((slot - hole) & mask)) continue;
+
+        ali__hm_set_ctrl(table, hole, table->ctrl[slot]);
+        table->keys[hole] = table->keys[slot];
+        memcpy((ali_u8*)values + hole * value_size, (ali_u8*)values + slot * value_size, value_size);
+        hole = slot;
+    }
+
+    ali__hm_set_ctrl(table, hole, ALI__HM_EMPTY);
+    table->count--;
+    return true;
+}
+
+ali_usize ali__hm_next(Ali_Hm_Table* table, ali_usize slot) {
+    while (slot < table->capacity && table->ctrl[slot] == ALI__HM_EMPTY) slot++;
+    return slot;
+}
+
+void ali__hm_clear(Ali_Hm_Table* table) {
+    if (table->capacity > 0) memset(table->ctrl, ALI__HM_EMPTY, table->capacity + ALI_HM_GROUP - 1);
+    table->count = 0;
+}
+
+void ali__hm_free(Ali_Hm_Table* table, void** values) {
+    if (table->capacity > 0) {
+        ali_free_ex(table->allocator, table->ctrl);
+        ali_free_ex(table->allocator, table->keys);
+        ali_free_ex(table->allocator, *values);
+    }
+    *table = (Ali_Hm_Table) { .allocator = table->allocator };
+    *values = NULL;
+}
+
+Ali_Interned ali_intern(Ali_Interner* interner, Ali_Sv sv) {
+    ali_u32* id = ali_hm_find(&interner->ids, sv);
+    if (id != NULL) return (Ali_Interned) { .id = *id, .sv = interner->strs.items[*id] };
+
+    if (interner->strs.count == 0) ali_da_append(&interner->strs, ((Ali_Sv) {0})); // id 0
+
+    char* copy = ali_alloc_aligned_ex(ali_dynamic_arena_allocator(&interner->arena), sv.len + 1, 1);
+    if (sv.len > 0) memcpy(copy, sv.start, sv.len);
+    copy[sv.len] = 0;
+
+    Ali_Interned interned = {
+        .id = interner->strs.count,
+        .sv = ali_sv_from_parts(copy, sv.len),
+    };
+    ali_da_append(&interner->strs, interned.sv);
+    ali_hm_put(&interner->ids, interned.sv, interned.id);
+    return interned;
+}
+
+Ali_Sv ali_interner_get(Ali_Interner* interner, ali_u32 id) {
+    ali_assert(id > 0 && id < interner->strs.count);
+    return interner->strs.items[id];
+}
+
+void ali_interner_free(Ali_Interner* interner) {
+    ali_freeall_ex(ali_dynamic_arena_allocator(&interner->arena));
+    ali_da_free(&interner->strs);
+    ali_hm_free(&interner->ids);
+}
+
+#ifndef _WIN32
+// both ends are close-on-exec, so jobs only get the ends that are dup2'ed into them
+bool ali_pipe2(int p[2]) {
+    if (pipe(p) < 0) {
+        ali_log_error("Couldn't create pipe: %s", ali_libc_get_error());
+        return false;
+    }
+    fcntl(p[0], F_SETFD, FD_CLOEXEC);
+    fcntl(p[1], F_SETFD, FD_CLOEXEC);
+    return true;
+}
+
+bool ali_sv_read_file_mmap(const char* filepath, Ali_Sv* sv) {
+    int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    bool result = true;
+    int saved_errno = 0;
+    struct stat st;
+    if (fstat(fd, &st) < 0) ali_return_defer(false);
+
+    // mmap can't map nothing
+    *sv = (Ali_Sv) {0};
+    if (st.st_size > 0) {
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) ali_return_defer(false);
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        *sv = ali_sv_from_parts(data, st.st_size);
+    }
+
+defer:
+    saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return result;
+}
+
+void ali_sv_unmap_file(Ali_Sv sv) {
+    if (sv.len > 0) munmap((void*)sv.start, sv.len);
+}
+#else // _WIN32
+bool ali_sv_read_file_mmap(const char* filepath, Ali_Sv* sv) {
+    Ali_Sb content = {0};
+    if (!ali__read_entire_file(filepath, &content)) {
+        ali_da_free(&content);
+        return false;
+    }
+    *sv = ali_sb_to_sv(&content);
+    return true;
+}
+
+void ali_sv_unmap_file(Ali_Sv sv) {
+    if (sv.start != NULL) ali_free_ex(ali_libc_allocator, (void*)sv.start);
+}
+#endif // _WIN32
+
+Ali_Stat_Cache* ali_global_stat_cache = NULL;
+
+bool ali__file_mtime_uncached(const char* filepath, ali_i64* mtime) {
+    struct stat st;
+    if (stat(filepath, &st) < 0) return false;
+    *mtime = (ali_i64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+bool ali_stat_cache_mtime(Ali_Stat_Cache* cache, const char* filepath, ali_i64* mtime) {
+    Ali_Stat_Entry* entry = ali_hm_find(cache, ali_sv_from_cstr(filepath));
+    if (entry == NULL) {
+        // the key has to outlive filepath
+        char* path = ali__cstr_dup(filepath);
+        entry = ali_hm_entry(cache, ali_sv_from_cstr(path), NULL);
+        entry->path = path;
+    }
+
+    if (entry->valid) {
+        cache->saved_calls++;
+        errno = entry->error;
+    } else {
+        cache->stat_calls++;
+        entry->exists = ali__file_mtime_uncached(filepath, &entry->mtime);
+        entry->error = entry->exists ? 0 : errno;
+        entry->valid = true;
+    }
+
+    if (entry->exists) *mtime = entry->mtime;
+    return entry->exists;
+}
+
+void ali_stat_cache_invalidate(Ali_Stat_Cache* cache, const char* filepath) {
+    Ali_Stat_Entry* entry = ali_hm_find(cache, ali_sv_from_cstr(filepath));
+    if (entry != NULL) entry->valid = false;
+}
+
+void ali_stat_cache_free(Ali_Stat_Cache* cache) {
+    ali_hm_foreach(cache, slot) {
+        free(cache->values[slot].path);
+    }
+    ali_hm_free(cache);
+    *cache = (Ali_Stat_Cache) {0};
+}
+
+bool ali_file_mtime(const char* filepath, ali_i64* mtime) {
+    if (ali_global_stat_cache != NULL) return ali_stat_cache_mtime(ali_global_stat_cache, filepath, mtime);
+    return ali__file_mtime_uncached(filepath, mtime);
+}
+
+bool ali_is_file1_modified_after_file2(const char* filepath1, const char* filepath2) {
+    ali_i64 file1_time = 0;
+    if (!ali_file_mtime(filepath1, &file1_time)) {
+        ali_log_error("Couldn't stat %s: %s", filepath1, ali_libc_get_error());
+        return false;
+    }
+
+    ali_i64 file2_time = 0;
+    if (!ali_file_mtime(filepath2, &file2_time)) {
+        return true;
+    }
+
+    return file1_time > file2_time;
+}
+
+bool ali_rename(const char* from, const char* to) {
+    if (rename(from, to) < 0) {
+        ali_log_error("Couldn't rename %s to %s: %s", from, to, ali_libc_get_error());
+        return false;
+    }
+    return true;
+}
+
+bool ali_remove(const char* filepath) {
+    if (remove(filepath) < 0) {
+        ali_log_error("Couldn't remove %s: %s", filepath, ali_libc_get_error());
+        return false;
+    }
+    return true;
+}
+
+bool ali_mkdir_if_not_exists(const char* path) {
+    if (mkdir(path, 0775) < 0) {
+        switch (errno) {
+            case EEXIST:
+                ali_log_debug("Directory %s already exists", path);
+                break; // ignore
+            default:
+                ali_log_error("Couldn't create directory %s: %s", path, ali_libc_get_error());
+                return false;
+        }
+    }
+    return true;
+}
+
+bool ali_mkdir_deep_if_not_exists(const char* path) {
+    bool result = true;
+    Ali_Arena_Mark stamp = ali_tstamp();
+    char* buffer = ali_tsprintf("%s", path);
+
+    // every prefix that ends right before a slash, but not the empty one of /abs/path (or a//b)
+    for (char* slash = strchr(buffer, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        if (slash == buffer || slash[-1] == '/') continue;
+        *slash = 0;
+        bool ok = strcmp(buffer, ".") == 0 || ali_mkdir_if_not_exists(buffer);
+        *slash = '/';
+        if (!ok) ali_return_defer(false);
+    }
+    if (!ali_mkdir_if_not_exists(path)) ali_return_defer(false);
+
+defer:
+    ali_trewind(stamp);
+    return result;
+}
+
+bool ali_copy_file(const char* from, const char* to) {
+    bool result = true;
+    int from_fd = -1, to_fd = -1;
+
+    from_fd = open(from, O_RDONLY);
+    if (from_fd < 0) {
+        ali_log_error("Couldn't open %s: %s", from, ali_libc_get_error());
+        ali_return_defer(false);
+    }
+
+    struct stat st;
+    if (fstat(from_fd, &st) < 0) {
+        ali_log_error("Couldn't stat %s: %s", from, ali_libc_get_error());
+        ali_return_defer(false);
+    }
+
+    to_fd = open(to, O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 0777);
+    if (to_fd < 0) {
+        ali_log_error("Couldn't open %s: %s", to, ali_libc_get_error());
+        ali_return_defer(false);
+    }
+
+    char buffer[64 << 10];
+    for (;;) {
+        ssize_t n = read(from_fd, buffer, sizeof(buffer));
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ali_log_error("Couldn't read %s: %s", from, ali_libc_get_error());
+            ali_return_defer(false);
+        }
+
+        for (ssize_t written = 0; written < n;) {
+            ssize_t m = write(to_fd, buffer + written, n - written);
+            if (m < 0) {
+                if (errno == EINTR) continue;
+                ali_log_error("Couldn't write %s: %s", to, ali_libc_get_error());
+                ali_return_defer(false);
+            }
+            written += m;
+        }
+    }
+
+    if (fchmod(to_fd, st.st_mode & 0777) < 0) {
+        ali_log_error("Couldn't change permissions of %s: %s", to, ali_libc_get_error());
+        ali_return_defer(false);
+    }
+
+defer:
+    if (from_fd >= 0) close(from_fd);
+    if (to_fd >= 0) close(to_fd);
+    return result;
+}
+
+bool ali__job_open_pipes(Ali_Job* job, AliJobRedirect redirect) {
+    if (redirect & (ALI_REDIRECT_STDOUT | ALI_REDIRECT_STDERR)) {
+        if (!ali_pipe2(job->out)) return false;
+    }
+
+    if (redirect & ALI_REDIRECT_STDIN) {
+        if (!ali_pipe2(job->in)) {
+            if (redirect & (ALI_REDIRECT_STDOUT | ALI_REDIRECT_STDERR)) {
+                close(job->out[0]);
+                close(job->out[1]);
+            }
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// the child has its own copies of these, and the parent holding on to the write end
+// of job.out would keep it from ever seeing EOF
+void ali__job_close_child_ends(Ali_Job* job, AliJobRedirect redirect, bool started) {
+    if (redirect & (ALI_REDIRECT_STDOUT | ALI_REDIRECT_STDERR)) {
+        close(job->out[1]);
+        if (!started) close(job->out[0]);
+    }
+    if (redirect & ALI_REDIRECT_STDIN) {
+        close(job->in[0]);
+        if (!started) close(job->in[1]);
+    }
+}
+
+Ali_Job ali_job_start_posix_fork(char** argv, AliJobRedirect redirect) {
+    Ali_Job job = {0};
+    job.handle = -1;
+
+    if (!ali__job_open_pipes(&job, redirect)) return job;
+
+    job.handle = fork();
+    if (job.handle < 0) {
+        ali_log_error("Couldn't start process: %s", ali_libc_get_error());
+    } else if (job.handle == 0) {
+        if (redirect & ALI_REDIRECT_STDIN) dup2(job.in[0], STDIN_FILENO);
+        if (redirect & ALI_REDIRECT_STDOUT) dup2(job.out[1], STDOUT_FILENO);
+        if (redirect & ALI_REDIRECT_STDERR) dup2(job.out[1], STDERR_FILENO);
+
+        execvp(argv[0], argv);
+        ali_log_error("Couldn't start program '%s': %s", argv[0], ali_libc_get_error());
+        _exit(1);
+    }
+
+    ali__job_close_child_ends(&job, redirect, job.handle >= 0);
+    return job;
+}
+
+extern char** environ;
+
+Ali_Job ali_job_start_posix_spawn(char** argv, AliJobRedirect redirect) {
+    Ali_Job job = {0};
+    job.handle = -1;
+
+    if (!ali__job_open_pipes(&job, redirect)) return job;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (redirect & ALI_REDIRECT_STDIN) posix_spawn_file_actions_adddup2(&actions, job.in[0], STDIN_FILENO);
+    if (redirect & ALI_REDIRECT_STDOUT) posix_spawn_file_actions_adddup2(&actions, job.out[1], STDOUT_FILENO);
+    if (redirect & ALI_REDIRECT_STDERR) posix_spawn_file_actions_adddup2(&actions, job.out[1], STDERR_FILENO);
+
+    pid_t pid;
+    int error = posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (error != 0) {
+        ali_log_error("Couldn't start program '%s': %s", argv[0], strerror(error));
+    } else {
+        job.handle = pid;
+    }
+
+    ali__job_close_child_ends(&job, redirect, job.handle >= 0);
+    return job;
+}
+
+// returns -1 if the process hasn't terminated yet
+int ali__job_check_wstatus_posix(int wstatus) {
+    if (WIFEXITED(wstatus)) {
+        int estatus = WEXITSTATUS(wstatus);
+        if (estatus != 0) {
+            ali_log_error("Process exited with status %d", estatus);
+            return false;
+        }
+
+        return true;
+    }
+
+    if (WIFSIGNALED(wstatus)) {
+        ali_log_error("Process exited with signal %d", WTERMSIG(wstatus));
+        return false;
+    }
+
+    return -1;
+}
+
+bool ali_job_wait_posix(Ali_Job job) {
+    for (;;) {
+        int wstatus;
+        if (waitpid(job.handle, &wstatus, 0) < 0) {
+            ali_log_error("Couldn't wait for process: %s", ali_libc_get_error());
+            return false;
+        }
+
+        int ok = ali__job_check_wstatus_posix(wstatus);
+        if (ok >= 0) return ok;
+    }
+}
+
+bool ali_jobs_wait_any_posix(Ali_Jobs* jobs, ali_usize* index) {
+    ali_assert(jobs->count > 0);
+
+    // waitpid(-1) would also reap (and lose) children that aren't ours, so every job is
+    // checked with WNOHANG and we sleep on their pidfds (or a short timeout without them)
+    struct pollfd* fds = ali_alloc_ex(ali_libc_allocator, sizeof(*fds) * jobs->count);
+    int timeout = -1;
+    for (ali_usize i = 0; i < jobs->count; ++i) {
+        fds[i] = (struct pollfd) { .fd = -1, .events = POLLIN };
+#ifdef SYS_pidfd_open
+        fds[i].fd = syscall(SYS_pidfd_open, jobs->items[i].handle, 0);
+#endif // SYS_pidfd_open
+        if (fds[i].fd < 0) timeout = 10;
+    }
+
+    bool result = false;
+    int saved_errno = 0;
+    for (;;) {
+        for (ali_usize i = 0; i < jobs->count; ++i) {
+            int wstatus;
+            pid_t pid = waitpid(jobs->items[i].handle, &wstatus, WNOHANG);
+            if (pid == 0) continue;
+            if (pid < 0) {
+                if (errno == EINTR) {
+                    --i;
+                    continue;
+                }
+                ali_log_error("Couldn't wait for process: %s", ali_libc_get_error());
+                *index = jobs->count;
+                ali_return_defer(false);
+            }
+
+            int ok = ali__job_check_wstatus_posix(wstatus);
+            if (ok < 0) continue;
+            *index = i;
+            ali_return_defer(ok);
+        }
+
+        if (poll(fds, jobs->count, timeout) < 0 && errno != EINTR) {
+            ali_log_error("Couldn't wait for process: %s", ali_libc_get_error());
+            *index = jobs->count;
+            ali_return_defer(false);
+        }
+    }
+
+defer:
+    saved_errno = errno;
+    for (ali_usize i = 0; i < jobs->count; ++i) {
+        if (fds[i].fd >= 0) close(fds[i].fd);
+    }
+    ali_free_ex(ali_libc_allocator, fds);
+    errno = saved_errno;
+    return result;
+}
+
+Ali_Job ali_job_start_argv(char** argv, AliJobRedirect redirect) {
+#ifdef _WIN32
+#error "TODO: windows"
+#elif defined(ALI_JOB_USE_FORK)
+    return ali_job_start_posix_fork(argv, redirect);
+#else // _WIN32
+    return ali_job_start_posix_spawn(argv, redirect);
+#endif // _WIN32
+}
+
+Ali_Job ali_job_start(char** cmd, ali_usize cmd_count, AliJobRedirect redirect) {
+    char* small_argv[64];
+    char** argv = small_argv;
+    if (cmd_count + 1 > ali_array_len(small_argv)) {
+        argv = ali_alloc_ex(ali_libc_allocator, sizeof(cmd[0]) * (cmd_count + 1));
+    }
+    memcpy(argv, cmd, sizeof(cmd[0]) * cmd_count);
+    argv[cmd_count] = NULL;
+
+    Ali_Job job = ali_job_start_argv(argv, redirect);
+
+    if (argv != small_argv) ali_free_ex(ali_libc_allocator, argv);
+    return job;
+}
+
+bool ali_job_wait(Ali_Job job) {
+#ifdef _WIN32
+#error "TODO: windows"
+#else // _WIN32
+    return ali_job_wait_posix(job);
+#endif // _WIN32
+}
+
+bool ali_job_run(char **cmd, ali_usize cmd_count, AliJobRedirect redirect) {
+    Ali_Job job = ali_job_start(cmd, cmd_count, redirect);
+    return ali_job_wait(job);
+}
+
+bool ali_jobs_wait(Ali_Jobs jobs) {
+    bool result = true;
+    ali_da_foreach(&jobs, Ali_Job, job) {
+        if (!ali_job_wait(*job)) result = false;
+    }
+    return result;
+}
+
+bool ali_jobs_wait_and_reset(Ali_Jobs* jobs) {
+    bool result = true;
+    ali_da_foreach(jobs, Ali_Job, job) {
+        if (!ali_job_wait(*job)) result = false;
+    }
+    jobs->count = 0;
+    return result;
+}
+
+bool ali_jobs_wait_any(Ali_Jobs* jobs, ali_usize* index) {
+#ifdef _WIN32
+#error "TODO: windows"
+#else // _WIN32
+    return ali_jobs_wait_any_posix(jobs, index);
+#endif // _WIN32
+}
+
+void ali_cmd_append_many_null(Ali_Cmd* cmd, char* arg1, ...) {
+    ali_cmd_append(cmd, arg1);
+
+    va_list args;
+    va_start(args, arg1);
+    char* arg = va_arg(args, char*);
+    while (arg != NULL) {
+        ali_cmd_append(cmd, arg);
+        arg = va_arg(args, char*);
+    }
+    va_end(args);
+}
+
+// a da always has a free slot after its last item, so the cmd can be NULL terminated in place
+Ali_Job ali__cmd_start(Ali_Cmd* cmd, AliJobRedirect redirect) {
+    if (cmd->count < cmd->capacity) {
+        cmd->items[cmd->count] = NULL;
+        return ali_job_start_argv(cmd->items, redirect);
+    }
+    return ali_job_start(cmd->items, cmd->count, redirect);
+}
+
+Ali_Job ali_cmd_run_async(Ali_Cmd cmd, AliJobRedirect redirect) {
+    Ali_Sb sb = {0};
+    ali_sb_render_cmd(&sb, cmd.items, cmd.count);
+
+    Ali_Sv rendered = ali_sb_to_sv(&sb);
+    ali_log_info("[CMD] "SV_FMT, SV_F(rendered));
+
+    ali_da_free(&sb);
+    Ali_Job job = ali__cmd_start(&cmd, redirect);
+    return job;
+}
+
+bool ali_cmd_run_sync(Ali_Cmd cmd) {
+    Ali_Job job = ali_cmd_run_async(cmd, 0);
+    return ali_job_wait(job);
+}
+
+Ali_Job ali_cmd_run_async_and_reset(Ali_Cmd* cmd, AliJobRedirect redirect) {
+    Ali_Sb sb = {0};
+    ali_sb_render_cmd(&sb, cmd->items, cmd->count);
+
+    Ali_Sv rendered = ali_sb_to_sv(&sb);
+    ali_log_info("[CMD] "SV_FMT, SV_F(rendered));
+
+    ali_da_free(&sb);
+    Ali_Job job = ali__cmd_start(cmd, redirect);
+    cmd->count = 0;
+    return job;
+}
+
+bool ali_cmd_run_sync_and_reset(Ali_Cmd* cmd) {
+    Ali_Job job = ali_cmd_run_async_and_reset(cmd, 0);
+    return ali_job_wait(job);
+}
+
+bool ali_job_pool_start(Ali_Job_Pool* pool, Ali_Cmd* cmd, ali_usize id) {
+    Ali_Pool_Job pool_job = {0};
+    pool_job.id = id;
+    pool_job.pidfd = -1;
+    pool_job.start_ns = ali_monotonic_ns();
+    pool_job.job = ali_cmd_run_async_and_reset(cmd, ALI_REDIRECT_STDOUT | ALI_REDIRECT_STDERR);
+    if (pool_job.job.handle < 0) return false;
+
+    // we read whatever is there whenever poll() says so and never block on the pipe
+    fcntl(pool_job.job.out[0], F_SETFL, fcntl(pool_job.job.out[0], F_GETFL) | O_NONBLOCK);
+#ifdef SYS_pidfd_open
+    pool_job.pidfd = syscall(SYS_pidfd_open, pool_job.job.handle, 0);
+#endif // SYS_pidfd_open
+
+    ali_da_append(pool, pool_job);
+    return true;
+}
+
+// returns false once there is nothing more to read right now
+bool ali__pool_job_read(Ali_Pool_Job* pool_job) {
+    char chunk[4096];
+    ssize_t n = read(pool_job->job.out[0], chunk, sizeof(chunk));
+    if (n > 0) {
+        ali_da_append_many(&pool_job->output, chunk, n);
+        return true;
+    }
+    if (n < 0 && errno == EINTR) return true;
+    if (n < 0 && errno == EAGAIN) return false;
+
+    pool_job->eof = true;
+    close(pool_job->job.out[0]);
+    return false;
+}
+
+void ali__pool_job_reap(Ali_Pool_Job* pool_job) {
+    struct rusage usage = {0};
+    while (wait4(pool_job->job.handle, &pool_job->wstatus, 0, &usage) < 0) {
+        if (errno == EINTR) continue;
+        ali_log_error("Couldn't wait for process: %s", ali_libc_get_error());
+        pool_job->wait_failed = true;
+        break;
+    }
+    pool_job->end_ns = ali_monotonic_ns();
+    pool_job->max_rss_kib = usage.ru_maxrss;
+    pool_job->exited = true;
+    if (pool_job->pidfd >= 0) close(pool_job->pidfd);
+    pool_job->pidfd = -1;
+}
+
+bool ali__pool_job_complete(Ali_Job_Pool* pool, ali_usize index, Ali_Job_Result* result) {
+    Ali_Pool_Job* pool_job = &pool->items[index];
+
+    // one write, so it doesn't get mixed with anything else writing to stderr
+    fflush(stderr);
+    for (ali_usize written = 0; written < pool_job->output.count;) {
+        ssize_t n = write(STDERR_FILENO, pool_job->output.items + written, pool_job->output.count - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        written += n;
+    }
+
+    result->reaped = true;
+    result->id = pool_job->id;
+    if (pool_job->wait_failed) {
+        result->ok = false;
+        result->exit_code = -1;
+    } else {
+        result->ok = ali__job_check_wstatus_posix(pool_job->wstatus) > 0;
+        result->exit_code = WIFEXITED(pool_job->wstatus) ? WEXITSTATUS(pool_job->wstatus) : -1;
+    }
+    result->start_ns = pool_job->start_ns;
+    result->end_ns = pool_job->end_ns;
+    result->max_rss_kib = pool_job->max_rss_kib;
+
+    ali_da_free(&pool_job->output);
+    ali_da_remove_unordered(pool, index);
+    return result->ok;
+}
+
+bool ali_job_pool_wait_any(Ali_Job_Pool* pool, Ali_Job_Result* result) {
+    ali_assert(pool->count > 0);
+
+    struct pollfd* fds = ali_alloc_ex(ali_libc_allocator, sizeof(*fds) * pool->count * 2);
+    ali_usize* fd_jobs = ali_alloc_ex(ali_libc_allocator, sizeof(*fd_jobs) * pool->count * 2);
+    bool ok = false;
+    result->reaped = false;
+
+    for (;;) {
+        for (ali_usize i = 0; i < pool->count; ++i) {
+            if (pool->items[i].exited && pool->items[i].eof) {
+                ok = ali__pool_job_complete(pool, i, result);
+                goto defer;
+            }
+        }
+
+        ali_usize fds_count = 0;
+        for (ali_usize i = 0; i < pool->count; ++i) {
+            Ali_Pool_Job* pool_job = &pool->items[i];
+            if (!pool_job->eof) {
+                fds[fds_count] = (struct pollfd) { .fd = pool_job->job.out[0], .events = POLLIN };
+                fd_jobs[fds_count++] = i;
+            }
+            if (!pool_job->exited && pool_job->pidfd >= 0) {
+                fds[fds_count] = (struct pollfd) { .fd = pool_job->pidfd, .events = POLLIN };
+                fd_jobs[fds_count++] = i;
+            }
+        }
+
+        // nothing left to poll (see below), so all there is to do is wait for them one by one
+        if (fds_count == 0) {
+            for (ali_usize i = 0; i < pool->count; ++i) {
+                if (pool->items[i].exited) continue;
+                ali__pool_job_reap(&pool->items[i]);
+                break;
+            }
+            continue;
+        }
+
+        if (poll(fds, fds_count, -1) < 0) {
+            if (errno == EINTR) continue;
+            ali_log_error("Couldn't poll jobs: %s", ali_libc_get_error());
+            // give up on their output and pidfds, the next wait falls back to blocking on each job
+            ali_da_foreach(pool, Ali_Pool_Job, pool_job) {
+                if (!pool_job->eof) close(pool_job->job.out[0]);
+                pool_job->eof = true;
+                if (pool_job->pidfd >= 0) close(pool_job->pidfd);
+                pool_job->pidfd = -1;
+            }
+            goto defer;
+        }
+
+        for (ali_usize i = 0; i < fds_count; ++i) {
+            if (fds[i].revents == 0) continue;
+            Ali_Pool_Job* pool_job = &pool->items[fd_jobs[i]];
+
+            if (fds[i].fd == pool_job->pidfd) {
+                ali__pool_job_reap(pool_job);
+                // take what's left in the pipe, but don't wait for anyone the job left running
+                if (!pool_job->eof) {
+                    while (ali__pool_job_read(pool_job)) {}
+                    if (!pool_job->eof) {
+                        close(pool_job->job.out[0]);
+                        pool_job->eof = true;
+                    }
+                }
+            } else if (!pool_job->eof) {
+                while (ali__pool_job_read(pool_job)) {}
+                // without a pidfd, EOF is the sign the job is done
+                if (pool_job->eof && pool_job->pidfd < 0) ali__pool_job_reap(pool_job);
+            }
+        }
+    }
+
+defer:
+    ali_free_ex(ali_libc_allocator, fds);
+    ali_free_ex(ali_libc_allocator, fd_jobs);
+    return ok;
+}
+
+bool ali_job_pool_wait_all(Ali_Job_Pool* pool) {
+    bool result = true;
+    while (pool->count > 0) {
+        Ali_Job_Result job_result;
+        if (!ali_job_pool_wait_any(pool, &job_result)) result = false;
+    }
+    return result;
+}
+
+void ali_job_pool_free(Ali_Job_Pool* pool) {
+    ali_job_pool_wait_all(pool);
+    ali_da_free(pool);
+}
+
+const char* ali__debug_to_str[ALI_DEBUG_COUNT_] = {
+    [ALI_DEBUG_NONE] = "-g0",
+    [ALI_DEBUG_AUTO] = "-g",
+    [ALI_DEBUG_GDB] = "-ggdb",
+};
+
+const char* ali__optimize_to_str[ALI_OPTIMIZE_COUNT_] = {
+    [ALI_OPTIMIZE_NONE] = "-O0",
+    [ALI_OPTIMIZE_ONE] = "-O1",
+    [ALI_OPTIMIZE_TWO] = "-O2",
+    [ALI_OPTIMIZE_THREE] = "-O3",
+    [ALI_OPTIMIZE_FAST] = "-Ofast",
+    [ALI_OPTIMIZE_SIZE] = "-Os",
+    [ALI_OPTIMIZE_SIZE_AGRESSIVE] = "-Oz",
+};
+
+void ali_step_free(Ali_Step* step) {
+    ali_da_foreach(&step->srcs, Ali_Step, substep) {
+        ali_step_free(substep);
+    }
+    ali_da_free(&step->srcs);
+    ali_da_foreach(&step->deps, Ali_Step, substep) {
+        ali_step_free(substep);
+    }
+    ali_da_free(&step->deps);
+    ali_da_free(&step->linker_flags);
+}
+
+bool ali_step_need_rebuild(Ali_Step* step) {
+    ali_da_foreach(&step->srcs, Ali_Step, substep) {
+        if (ali_step_need_rebuild(substep)) return true;
+        if (ali_need_rebuild(step->name, substep->name)) return true;
+    }
+    ali_da_foreach(&step->deps, Ali_Step, substep) {
+        if (ali_step_need_rebuild(substep)) return true;
+        if (ali_need_rebuild(step->name, substep->name)) return true;
+    }
+    return false;
+}
+
+Ali_Step ali_step_file(char* name) {
+    return (Ali_Step) {
+        .name = name,
+        .type = ALI_STEP_FILE,
+    };
+}
+
+Ali_Step ali_step_executable(char* name, Ali_Debug_Type debug, Ali_Optimize_Type optimize) {
+    return (Ali_Step) {
+        .name = name,
+        .type = ALI_STEP_EXE,
+        .debug = debug,
+        .optimize = optimize,
+    };
+}
+
+Ali_Step ali_step_dynamic(char* name, Ali_Debug_Type debug, Ali_Optimize_Type optimize) {
+    return (Ali_Step) {
+        .name = name,
+        .type = ALI_STEP_DYNAMIC,
+        .debug = debug,
+        .optimize = optimize,
+    };
+}
+
+Ali_Step ali_step_static(char* name, Ali_Debug_Type debug, Ali_Optimize_Type optimize) {
+    return (Ali_Step) {
+        .name = name,
+        .type = ALI_STEP_STATIC,
+        .debug = debug,
+        .optimize = optimize,
+    };
+}
+
+Ali_Step ali_step_object(char* name, Ali_Debug_Type debug, Ali_Optimize_Type optimize) {
+    return (Ali_Step) {
+        .name = name,
+        .type = ALI_STEP_OBJECT,
+        .debug = debug,
+        .optimize = optimize,
+    };
+}
+
+void ali_step_add_src(Ali_Step* step, Ali_Step substep) {
+    ali_da_append(&step->srcs, substep);
+}
+
+void ali_step_add_dep(Ali_Step* step, Ali_Step substep) {
+    ali_da_append(&step->deps, substep);
+}
+
+const char* ali__build_dir(Ali_Build_Nodes* nodes) {
+    return nodes->build_dir != NULL ? nodes->build_dir : ALI_BUILD_DIR;
+}
+
+ali_isize ali__build_nodes_find(Ali_Build_Nodes* nodes, const char* name) {
+    ali_usize* index = ali_hm_find(&nodes->by_name, ali_sv_from_cstr(name));
+    return index != NULL ? (ali_isize)*index : -1;
+}
+
+ali_usize ali__build_nodes_push(Ali_Build_Nodes* nodes, Ali_Build_Node node) {
+    node.pending = node.srcs.count + node.deps.count;
+
+    ali_usize node_index = nodes->count;
+    ali_da_append(nodes, node);
+    bool existed = false;
+    ali_usize* index = ali_hm_entry(&nodes->by_name, ali_sv_from_cstr(node.name), &existed);
+    if (!existed) *index = node_index;
+
+    Ali_Build_Node* added = &nodes->items[node_index];
+    ali_da_foreach(&added->srcs, ali_usize, index) {
+        ali_da_append(&nodes->items[*index].dependents, node_index);
+    }
+    ali_da_foreach(&added->deps, ali_usize, index) {
+        ali_da_append(&nodes->items[*index].dependents, node_index);
+    }
+
+    return node_index;
+}
+
+// <build_dir>/<step>/<src without .c>.o, with any ../ turned into __/ so it stays in build_dir
+char* ali__build_object_path(const char* build_dir, const char* step_name, const char* src_name) {
+    Ali_Sv src = ali_sv_strip_suffix(ali_sv_from_cstr(src_name), SV(".c"));
+    while (src.len > 0 && *src.start == '/') src = ali_sv_from_parts(src.start + 1, src.len - 1);
+
+    Ali_Sb sb = {0};
+    ali_sb_sprintf(&sb, "%s/%s/", build_dir, step_name);
+    while (src.len > 0) {
+        if (ali_sv_starts_with_prefix(src, SV("../"))) {
+            ali_da_append_many(&sb, "__/", 3);
+            src = ali_sv_strip_prefix(src, SV("../"));
+        } else {
+            ali_da_append(&sb, *src.start);
+            src = ali_sv_from_parts(src.start + 1, src.len - 1);
+        }
+    }
+    ali_da_append_many(&sb, ".o", 2);
+
+    char* path = ali_sb_to_cstr(&sb, ali_libc_allocator);
+    ali_da_free(&sb);
+    return path;
+}
+
+bool ali__step_is_compiled_src(Ali_Step* step, Ali_Step* src) {
+    switch (step->type) {
+        case ALI_STEP_EXE:
+        case ALI_STEP_STATIC:
+        case ALI_STEP_DYNAMIC:
+            return src->type == ALI_STEP_FILE && ali_sv_ends_with_suffix(ali_sv_from_cstr(src->name), SV(".c"));
+        default:
+            return false;
+    }
+}
+
+ali_usize ali__build_nodes_add_object(Ali_Build_Nodes* nodes, Ali_Step* step, Ali_Step* src) {
+    char* object_path = ali__build_object_path(ali__build_dir(nodes), step->name, src->name);
+
+    ali_isize existing = ali__build_nodes_find(nodes, object_path);
+    if (existing >= 0) {
+        free(object_path);
+        return existing;
+    }
+
+    Ali_Build_Node node = {0};
+    node.type = ALI_STEP_OBJECT;
+    node.name = object_path;
+    node.owns_name = true;
+    node.step = step;
+
+    ali_usize src_index = ali_build_nodes_add_step(nodes, src);
+    ali_da_append(&node.srcs, src_index);
+
+    return ali__build_nodes_push(nodes, node);
+}
+
+// only touches the file if the content changes, so the objects of unchanged batches stay up to date
+bool ali__build_write_unity_file(const char* path, const char* content) {
+    Ali_Sb old = {0};
+    bool result = true;
+    FILE* f = NULL;
+    ali_usize len = strlen(content);
+    if (ali__read_entire_file(path, &old) && old.count == len && ali_mem_eq(old.items, content, len)) {
+        ali_return_defer(true);
+    }
+
+    const char* slash = strrchr(path, '/');
+    if (!ali_mkdir_deep_if_not_exists(ali_tsprintf("%.*s", (int)(slash - path), path))) ali_return_defer(false);
+
+    f = fopen(path, "wb");
+    if (f == NULL) {
+        ali_log_error("Couldn't open %s: %s", path, ali_libc_get_error());
+        ali_return_defer(false);
+    }
+    if (fwrite(content, 1, len, f) != len) {
+        ali_log_error("Couldn't write %s: %s", path, ali_libc_get_error());
+        ali_return_defer(false);
+    }
+
+defer:
+    if (f != NULL) fclose(f);
+    ali_da_free(&old);
+    return result;
+}
+
+// batch holds indices into step->srcs
+ali_usize ali__build_nodes_add_unity(Ali_Build_Nodes* nodes, Ali_Step* step, ali_usize unity_index, Ali_Indices* batch) {
+    if (batch->count == 1) return ali__build_nodes_add_object(nodes, step, &step->srcs.items[batch->items[0]]);
+
+    Ali_Sb content = {0};
+    ali_sb_sprintf(&content, "// generated by ali2.h, do not edit\n");
+    // relative to the cwd (the object is compiled with -iquote .), so moving the tree around
+    // doesn't change the unity files or the cache keys of their objects
+    ali_da_foreach(batch, ali_usize, src_index) {
+        ali_sb_sprintf(&content, "#include \"%s\"\n", step->srcs.items[*src_index].name);
+    }
+
+    Ali_Arena_Mark stamp = ali_tstamp();
+    Ali_Build_Node file = {0};
+    file.type = ALI_STEP_FILE;
+    file.name = ali__cstr_dup(ali_tsprintf("%s/%s/unity_%zu.c", ali__build_dir(nodes), step->name, unity_index));
+    file.owns_name = true;
+    file.step = step;
+    file.generated = ali_sb_to_cstr(&content, ali_libc_allocator);
+    ali_da_free(&content);
+
+    Ali_Build_Node node = {0};
+    node.type = ALI_STEP_OBJECT;
+    node.name = ali__cstr_dup(ali_tsprintf("%s/%s/unity_%zu.o", ali__build_dir(nodes), step->name, unity_index));
+    node.owns_name = true;
+    node.step = step;
+    ali_trewind(stamp);
+
+    ali_usize file_index = ali__build_nodes_push(nodes, file);
+    ali_da_append(&node.srcs, file_index);
+    ali_da_foreach(batch, ali_usize, src_index) {
+        ali_usize index = ali_build_nodes_add_step(nodes, &step->srcs.items[*src_index]);
+        ali_da_append(&node.deps, index);
+    }
+
+    return ali__build_nodes_push(nodes, node);
+}
+
+ali_usize ali_build_nodes_add_step(Ali_Build_Nodes* nodes, Ali_Step* step) {
+    ali_isize existing = ali__build_nodes_find(nodes, step->name);
+    if (existing >= 0) return existing;
+
+    Ali_Build_Node node = {0};
+    node.type = step->type;
+    node.name = step->name;
+    node.step = step;
+
+    Ali_Indices batch = {0};
+    ali_usize unity_count = 0;
+    for (ali_usize i = 0; i < step->srcs.count; ++i) {
+        Ali_Step* substep = &step->srcs.items[i];
+        ali_usize index = 0;
+        if (step->unity_batch > 1 && ali__step_is_compiled_src(step, substep)) {
+            ali_da_append(&batch, i);
+            if (batch.count < step->unity_batch) continue;
+
+            index = ali__build_nodes_add_unity(nodes, step, unity_count++, &batch);
+            batch.count = 0;
+        } else if (ali__step_is_compiled_src(step, substep)) {
+            index = ali__build_nodes_add_object(nodes, step, substep);
+        } else {
+            index = ali_build_nodes_add_step(nodes, substep);
+        }
+        ali_da_append(&node.srcs, index);
+    }
+    if (batch.count > 0) {
+        ali_usize index = ali__build_nodes_add_unity(nodes, step, unity_count++, &batch);
+        ali_da_append(&node.srcs, index);
+    }
+    ali_da_free(&batch);
+    ali_da_foreach(&step->deps, Ali_Step, substep) {
+        ali_usize index = ali_build_nodes_add_step(nodes, substep);
+        ali_da_append(&node.deps, index);
+    }
+
+    return ali__build_nodes_push(nodes, node);
+}
+
+void ali__depfile_flush(Ali_Sb* path, Ali_Interner* interner, Ali_Cstrs* headers) {
+    if (path->count == 0) return;
+    ali_da_append(headers, (char*)ali_intern(interner, ali_sb_to_sv(path)).sv.start);
+    path->count = 0;
+}
+
+void ali_depfile_parse(Ali_Sv content, Ali_Interner* interner, Ali_Cstrs* headers) {
+    const char* c = content.start;
+    const char* end = content.start + content.len;
+
+    // skip the target, up to the first colon followed by whitespace (not the one of C:\)
+    for (;;) {
+        ali_isize colon = ali_sv_find_byte(ali_sv_from_parts(c, end - c), ':');
+        if (colon < 0) {
+            c = end;
+            break;
         }
-        if (flag->options.description != NULL) {
-            fprintf(f, " (%s)", flag->options.description);
+        c += colon;
+        if (c + 1 == end || c[1] == ' ' || c[1] == '\t' || c[1] == '\n') break;
+        c++;
+    }
+    if (c < end) c++;
+
+    Ali_Sb path = {0};
+    while (c < end) {
+        if (c[0] == '\\' && c + 1 < end && (c[1] == '\n' || c[1] == '\r')) {
+            ali__depfile_flush(&path, interner, headers);
+            c += 2;
+            if (c[-1] == '\r' && c < end && c[0] == '\n') c++;
+        } else if (c[0] == '\\' && c + 1 < end && c[1] == ' ') {
+            ali_da_append(&path, (char)' ');
+            c += 2;
+        } else if (c[0] == '$' && c + 1 < end && c[1] == '$') {
+            ali_da_append(&path, (char)'$');
+            c += 2;
+        } else if (c[0] == '\n') {
+            break;
+        } else if (c[0] == ' ' || c[0] == '\t' || c[0] == '\r') {
+            ali__depfile_flush(&path, interner, headers);
+            c++;
+        } else {
+            ali_da_append(&path, c[0]);
+            c++;
         }
-        fprintf(f, "\n");
     }
-    fprintf(f, "\n");
+    ali__depfile_flush(&path, interner, headers);
+
+    ali_da_free(&path);
 }
 
-bool ali_flag_parse(int argc, char** argv) {
-    flag_state.program = ali_shift(argv, argc);
+Ali_Depfile* ali_depfiles_find(Ali_Depfiles* depfiles, const char* target) {
+    ali_usize* index = ali_hm_find(&depfiles->index, ali_sv_from_cstr(target));
+    return index != NULL ? &depfiles->items[*index] : NULL;
+}
 
-    ali_isize pos = 0;
-    while (argc > 0) {
-        char* arg = ali_shift(argv, argc);
-        
-        if (*arg == '-' && *(arg + 1) == 0) goto pos_handling;
-        bool is_short = *arg == '-' && *(arg + 2) == 0;
-        bool is_long = *arg == '-' && *(arg + 1) == '-';
-        if (is_short || is_long) {
-            if (is_short) arg++;
-            else if (is_long) arg += 2;
+Ali_Depfile* ali__depfiles_append(Ali_Depfiles* depfiles, Ali_Depfile depfile) {
+    // the first depfile of a target wins, like it did when they were searched in order
+    bool existed = false;
+    ali_usize* index = ali_hm_entry(&depfiles->index, ali_sv_from_cstr(depfile.target), &existed);
+    if (!existed) *index = depfiles->count;
+    ali_da_append(depfiles, depfile);
+    return &depfiles->items[depfiles->count - 1];
+}
 
-            bool found = false;
-            for (ali_usize i = 0; i < flag_state.flags_count; ++i) {
-                Ali_Flag* current_flag = &flag_state.flags_array[i];
+Ali_Depfile* ali_depfiles_update(Ali_Depfiles* depfiles, const char* target, const char* depfile_path) {
+    Ali_Depfile* depfile = ali_depfiles_find(depfiles, target);
 
-                bool match = false;
-                match |= strcmp(arg, current_flag->options.name) == 0;
-                for (ali_usize i = 0; !match && i < current_flag->options.aliases_count; ++i) {
-                    match |= strcmp(arg, current_flag->options.aliases[i]) == 0;
-                }
+    ali_i64 mtime = 0;
+    if (!ali_file_mtime(depfile_path, &mtime)) return depfile;
+    if (depfile != NULL && depfile->mtime == mtime) return depfile;
 
-                if (!match) continue;
-                found = true;
+    Ali_Sv content = {0};
+    if (!ali_sv_read_file_mmap(depfile_path, &content)) {
+        ali_log_error("Couldn't read %s: %s", depfile_path, ali_libc_get_error());
+        return depfile;
+    }
 
-                switch (current_flag->type) {
-                    case FLAG_BOOL: {
-                                        current_flag->as.option = true;
-                                    } break;
-                    case FLAG_STRING: {
-                                          char* arg_value = ali_shift(argv, argc);
-                                          current_flag->as.string = arg_value;
-                                      } break;
-                    case FLAG_U64: {
-                                       char* arg_value = ali_shift(argv, argc);
-                                       current_flag->as.u64 = atoll(arg_value);
-                                   } break;
-                    case FLAG_F64: {
-                                       char* arg_value = ali_shift(argv, argc);
-                                       current_flag->as.f64 = atof(arg_value);
-                                   } break;
-                }
+    if (depfile == NULL) {
+        Ali_Depfile new_depfile = {0};
+        new_depfile.target = ali__cstr_dup(target);
+        depfile = ali__depfiles_append(depfiles, new_depfile);
+    } else {
+        ali_da_clear(&depfile->headers);
+    }
 
-                break;
-            }
+    depfile->mtime = mtime;
+    ali_depfile_parse(content, &depfiles->headers_interner, &depfile->headers);
+    depfiles->dirty = true;
 
-            if (!found) {
-                ali_log_error("Couldn't parse args");
-                ali_flag_print_usage(stderr);
-                return false;
+    ali_sv_unmap_file(content);
+    return depfile;
+}
+
+// <mtime> <target>
+// \t<header>
+// ...
+bool ali_depfiles_load(Ali_Depfiles* depfiles, const char* path) {
+    Ali_Sv content = {0};
+    if (!ali_sv_read_file_mmap(path, &content)) return false;
+
+    Ali_Depfile* current = NULL;
+    Ali_Tokenizer lines = ali_tokenizer(content);
+    for (Ali_Sv line; ali_tokenizer_next_line(&lines, &line);) {
+        if (ali_sv_starts_with_prefix(line, SV("\t"))) {
+            Ali_Sv header = ali_sv_strip_prefix(line, SV("\t"));
+            if (current != NULL) ali_da_append(&current->headers, (char*)ali_intern(&depfiles->headers_interner, header).sv.start);
+        } else {
+            ali_i64 mtime = 0;
+            current = NULL;
+            if (ali_sv_chop_i64(&line, &mtime) && ali_sv_starts_with_prefix(line, SV(" "))) {
+                Ali_Depfile depfile = {0};
+                depfile.mtime = mtime;
+                depfile.target = ali__sv_dup(ali_sv_strip_prefix(line, SV(" ")));
+                current = ali__depfiles_append(depfiles, depfile);
             }
         }
+    }
 
-pos_handling:
-        for (ali_usize i = 0; i < flag_state.flags_count; ++i) {
-            Ali_Flag* current_flag = &flag_state.flags_array[i];
+    ali_sv_unmap_file(content);
+    return true;
+}
 
-            if (current_flag->options.pos >= 0 && current_flag->options.pos == pos) {
-                switch (current_flag->type) {
-                    case FLAG_STRING: {
-                        current_flag->as.string = arg;
-                    } break;
-                    case FLAG_U64: {
-                        current_flag->as.u64 = atoll(arg);
-                    } break;
-                    case FLAG_F64: {
-                        current_flag->as.f64 = atof(arg);
-                    } break;
-                    case FLAG_BOOL: {}break;
-                }
+bool ali_depfiles_save(Ali_Depfiles* depfiles, const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        ali_log_error("Couldn't open %s: %s", path, ali_libc_get_error());
+        return false;
+    }
 
-                pos++;
-            }
+    ali_da_foreach(depfiles, Ali_Depfile, depfile) {
+        fprintf(f, "%lld %s\n", (long long)depfile->mtime, depfile->target);
+        ali_da_foreach(&depfile->headers, char*, header) {
+            fprintf(f, "\t%s\n", *header);
         }
     }
 
+    fclose(f);
+    depfiles->dirty = false;
     return true;
 }
 
-Ali_Slice ali_slice_slice(Ali_Slice slice, ali_usize start, ali_usize end) {
-    ali_assert(start < slice.count);
-    ali_assert(end <= slice.count);
-    ali_assert(start < end);
+void ali_depfiles_free(Ali_Depfiles* depfiles) {
+    ali_da_foreach(depfiles, Ali_Depfile, depfile) {
+        free(depfile->target);
+        ali_da_free(&depfile->headers);
+    }
+    ali_da_free(depfiles);
+    ali_hm_free(&depfiles->index);
+    ali_interner_free(&depfiles->headers_interner);
+    depfiles->dirty = false;
+}
 
-    return (Ali_Slice) {
-        .data_size = slice.data_size,
-        .count = end - start,
-        .data = slice.data + (slice.data_size * start),
-    };
+Ali_Build_Log_Entry* ali_build_log_find(Ali_Build_Log* log, const char* output) {
+    ali_usize* index = ali_hm_find(&log->index, ali_sv_from_cstr(output));
+    return index != NULL ? &log->items[*index] : NULL;
 }
 
-Ali_Slice ali_slice_to_byte_slice(Ali_Slice slice) {
-    return (Ali_Slice) {
-        .count = slice.count * slice.data_size,
-        .data = slice.data,
-        .data_size = 1,
-    };
+void ali__build_log_append(Ali_Build_Log* log, Ali_Build_Log_Entry entry) {
+    // the first entry of an output wins, like it did when the log was searched in order
+    bool existed = false;
+    ali_usize* index = ali_hm_entry(&log->index, ali_sv_from_cstr(entry.output), &existed);
+    if (!existed) *index = log->count;
+    ali_da_append(log, entry);
 }
 
-void* ali_slice_get(Ali_Slice slice, ali_usize index) {
-    ali_assert(index < slice.count);
-    return slice.data + slice.data_size * index;
+Ali_Build_Log_Entry* ali_build_log_record(Ali_Build_Log* log, const char* output, ali_u64 cmd_hash, ali_i64 mtime) {
+    Ali_Build_Log_Entry* entry = ali_build_log_find(log, output);
+    if (entry == NULL) {
+        Ali_Build_Log_Entry new_entry = {0};
+        new_entry.output = ali__cstr_dup(output);
+        ali__build_log_append(log, new_entry);
+        entry = &log->items[log->count - 1];
+    } else {
+        ali_da_clear(&entry->inputs);
+    }
+
+    entry->cmd_hash = cmd_hash;
+    entry->mtime = mtime;
+    log->dirty = true;
+    return entry;
 }
 
-Ali_Sv ali_sb_to_sv(Ali_Sb* sb) {
-    return ali_sv_from_parts(sb->items, sb->count);
+void ali__build_log_add_input_sv(Ali_Build_Log* log, Ali_Build_Log_Entry* entry, Ali_Sv path, ali_i64 mtime) {
+    Ali_Build_Log_Input input = {
+        .path = ali_intern(&log->paths, path).sv.start,
+        .mtime = mtime,
+    };
+    ali_da_append(&entry->inputs, input);
 }
 
-void ali_sb_sprintf(Ali_Sb* sb, const char* fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    int n = vsnprintf(NULL, 0, fmt, args);
-    va_end(args);
+void ali_build_log_add_input(Ali_Build_Log* log, Ali_Build_Log_Entry* entry, const char* path, ali_i64 mtime) {
+    ali__build_log_add_input_sv(log, entry, ali_sv_from_cstr(path), mtime);
+}
 
-    ali_da_resize_for(sb, n);
+#define ALI__BUILD_LOG_HEADER "# ali build log v1\n"
 
-    va_start(args, fmt);
-    int n_ = vsnprintf(sb->items + sb->count, n + 1, fmt, args);
-    ali_unused(n_);
-    va_end(args);
+// <cmd hash> <mtime> <output>
+// \t<mtime> <input>
+// ...
+bool ali_build_log_load(Ali_Build_Log* log, const char* path) {
+    Ali_Sv content = {0};
+    if (!ali_sv_read_file_mmap(path, &content)) return false;
 
-    sb->count += n;
-}
+    if (!ali_sv_starts_with_prefix(content, SV(ALI__BUILD_LOG_HEADER))) {
+        ali_log_warn("[BUILD] Ignoring %s, it was written by a different version", path);
+        ali_sv_unmap_file(content);
+        return false;
+    }
 
-char* ali_sb_to_cstr(Ali_Sb* sb, Ali_Allocator allocator) {
-    char* copy = ali_alloc_ex(allocator, sb->count + 1);
-    memcpy(copy, sb->items, sb->count);
-    copy[sb->count] = 0;
-    return copy;
-}
+    Ali_Build_Log_Entry* current = NULL;
+    Ali_Tokenizer lines = ali_tokenizer(ali_sv_strip_prefix(content, SV(ALI__BUILD_LOG_HEADER)));
+    for (Ali_Sv line; ali_tokenizer_next_line(&lines, &line);) {
+        if (ali_sv_starts_with_prefix(line, SV("\t"))) {
+            line = ali_sv_strip_prefix(line, SV("\t"));
+            ali_i64 mtime = 0;
+            if (current != NULL && ali_sv_chop_i64(&line, &mtime) && ali_sv_starts_with_prefix(line, SV(" "))) {
+                ali__build_log_add_input_sv(log, current, ali_sv_strip_prefix(line, SV(" ")), mtime);
+            }
+        } else {
+            ali_u64 cmd_hash = 0;
+            ali_i64 mtime = 0;
+            current = NULL;
+            if (!ali_sv_chop_u64(&line, 16, &cmd_hash) || !ali_sv_starts_with_prefix(line, SV(" "))) continue;
+            line = ali_sv_strip_prefix(line, SV(" "));
+            if (!ali_sv_chop_i64(&line, &mtime) || !ali_sv_starts_with_prefix(line, SV(" "))) continue;
+
+            Ali_Build_Log_Entry entry = {0};
+            entry.output = ali__sv_dup(ali_sv_strip_prefix(line, SV(" ")));
+            entry.cmd_hash = cmd_hash;
+            entry.mtime = mtime;
+            ali__build_log_append(log, entry);
+            current = &log->items[log->count - 1];
+        }
+    }
 
-Ali_Sv ali_sv_from_cstr(const char* cstr) {
-    Ali_Sv sv = {0};
-    sv.start = cstr;
-    sv.len = strlen(cstr);
-    return sv;
+    ali_sv_unmap_file(content);
+    return true;
 }
 
-Ali_Sv ali_sv_from_parts(const char* start, ali_usize len) {
-    return (Ali_Sv) {
-        .start = start,
-        .len = len,
-    };
-}
+bool ali_build_log_save(Ali_Build_Log* log, const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        ali_log_error("Couldn't open %s: %s", path, ali_libc_get_error());
+        return false;
+    }
 
-bool ali_sv_starts_with_prefix(Ali_Sv self, Ali_Sv prefix) {
-    if (self.len < prefix.len) return false;
-    for (ali_usize i = 0; i < prefix.len; ++i) {
-        if (self.start[i] != prefix.start[i]) return false;
+    fputs(ALI__BUILD_LOG_HEADER, f);
+    ali_da_foreach(log, Ali_Build_Log_Entry, entry) {
+        fprintf(f, "%016llx %lld %s\n", (unsigned long long)entry->cmd_hash, (long long)entry->mtime, entry->output);
+        ali_da_foreach(&entry->inputs, Ali_Build_Log_Input, input) {
+            fprintf(f, "\t%lld %s\n", (long long)input->mtime, input->path);
+        }
     }
+
+    fclose(f);
+    log->dirty = false;
     return true;
 }
 
-Ali_Sv ali_sv_strip_prefix(Ali_Sv self, Ali_Sv prefix) {
-    if (!ali_sv_starts_with_prefix(self, prefix)) return self;
-    self.len -= prefix.len; 
-    self.start += prefix.len; 
-    return self;
+void ali_build_log_free(Ali_Build_Log* log) {
+    ali_da_foreach(log, Ali_Build_Log_Entry, entry) {
+        free(entry->output);
+        ali_da_free(&entry->inputs);
+    }
+    ali_da_free(log);
+    ali_hm_free(&log->index);
+    ali_interner_free(&log->paths);
+    log->dirty = false;
 }
 
-bool ali_sv_ends_with_suffix(Ali_Sv self, Ali_Sv suffix) {
-    if (self.len < suffix.len) return false;
-    for (ali_usize i = 0; i < suffix.len; ++i) {
-        if (self.start[self.len - 1 - i] != suffix.start[suffix.len - 1 - i]) return false;
+void ali_build_nodes_free(Ali_Build_Nodes* nodes) {
+    ali_depfiles_free(&nodes->depfiles);
+    ali_build_log_free(&nodes->log);
+    ali_da_foreach(nodes, Ali_Build_Node, node) {
+        if (node->owns_name) free(node->name);
+        if (node->generated != NULL) ali_free_ex(ali_libc_allocator, node->generated);
+        ali_da_free(&node->srcs);
+        ali_da_free(&node->deps);
+        ali_da_free(&node->dependents);
     }
-    return true;
+    ali_da_free(nodes);
+    ali_hm_free(&nodes->by_name);
 }
 
-Ali_Sv ali_sv_strip_suffix(Ali_Sv self, Ali_Sv suffix) {
-    if (!ali_sv_ends_with_suffix(self, suffix)) return self;
-    self.len -= suffix.len;
-    return self;
+// <object without .o>.d, allocated in the temporary buffer
+char* ali__build_node_depfile(Ali_Build_Node* node) {
+    Ali_Sv object = ali_sv_strip_suffix(ali_sv_from_cstr(node->name), SV(".o"));
+    return ali_tsprintf(SV_FMT".d", SV_F(object));
 }
 
-bool ali_sv_eq(Ali_Sv a, Ali_Sv b) {
-    if (a.len != b.len) return false;
-    return ali_mem_eq(a.start, b.start, a.len);
+void ali__build_node_stat(Ali_Build_Node* node) {
+    if (node->stated) return;
+    node->exists = ali_file_mtime(node->name, &node->mtime);
+    node->stated = true;
 }
 
-void ali_sb_render_cmd(Ali_Sb* sb, char** cmd, ali_usize cmd_count) {
-    for (ali_usize i = 0; i < cmd_count; ++i) {
-        if (i != 0) ali_da_append(sb, (char)' ');
-        if (strchr(cmd[i], ' ') == NULL) {
-            int len = strlen(cmd[i]);
-            ali_da_append_many(sb, cmd[i], len);
-        } else {
-            ali_sb_sprintf(sb, "'%s'", cmd[i]);
-        }
+ali_u64 ali__build_cmd_hash(Ali_Cmd* cmd) {
+    ali_u64 hash = 0;
+    ali_da_foreach(cmd, char*, arg) {
+        hash = ali_hash_bytes(*arg, strlen(*arg) + 1, hash);
     }
+    return hash;
 }
 
-#ifndef _WIN32
-bool ali_pipe2(int p[2]) {
-    if (pipe(p) < 0) {
-        ali_log_error("Couldn't create pipe: %s", ali_libc_get_error());
-        return false;
+// Up to date if the cmd and the mtime of every input are the same as when it was recorded.
+// Headers don't need the depfile here, a different set of headers means an input changed.
+bool ali__build_log_entry_outdated(Ali_Build_Nodes* nodes, Ali_Build_Node* node, Ali_Build_Log_Entry* entry) {
+    if (entry->cmd_hash != node->cmd_hash) return true;
+    if (entry->mtime != node->mtime) return true;
+    if (entry->inputs.count < node->srcs.count + node->deps.count) return true;
+
+    ali_usize i = 0;
+    ali_da_foreach(&node->srcs, ali_usize, index) {
+        Ali_Build_Node* src = &nodes->items[*index];
+        ali__build_node_stat(src);
+        Ali_Build_Log_Input* input = &entry->inputs.items[i++];
+        if (!src->exists || src->mtime != input->mtime || strcmp(src->name, input->path) != 0) return true;
     }
-    return true;
+    ali_da_foreach(&node->deps, ali_usize, index) {
+        Ali_Build_Node* dep = &nodes->items[*index];
+        ali__build_node_stat(dep);
+        Ali_Build_Log_Input* input = &entry->inputs.items[i++];
+        if (!dep->exists || dep->mtime != input->mtime || strcmp(dep->name, input->path) != 0) return true;
+    }
+    for (; i < entry->inputs.count; ++i) {
+        Ali_Build_Log_Input* input = &entry->inputs.items[i];
+        ali_i64 mtime = 0;
+        if (!ali_file_mtime(input->path, &mtime) || mtime != input->mtime) return true;
+    }
+
+    return false;
 }
-#endif // _WIN32
 
-bool ali_is_file1_modified_after_file2(const char* filepath1, const char* filepath2) {
-    struct stat st;
+// srcs/deps are already done at this point, so there is no need to look further down the graph
+bool ali__build_node_need_rebuild(Ali_Build_Nodes* nodes, Ali_Build_Node* node) {
+    if (node->type == ALI_STEP_FILE) return false;
 
-    if (stat(filepath1, &st) < 0) {
-        ali_log_error("Couldn't stat %s: %s", filepath1, ali_libc_get_error());
-        return false;
+    ali__build_node_stat(node);
+    if (!node->exists) return true;
+
+    ali_da_foreach(&node->srcs, ali_usize, index) {
+        if (nodes->items[*index].rebuilt) return true;
+    }
+    ali_da_foreach(&node->deps, ali_usize, index) {
+        if (nodes->items[*index].rebuilt) return true;
     }
 
-    time_t file1_time = st.st_mtim.tv_sec;
-    if (stat(filepath2, &st) < 0) {
-        return true;
+    Ali_Build_Log_Entry* entry = ali_build_log_find(&nodes->log, node->name);
+    if (entry != NULL) return ali__build_log_entry_outdated(nodes, node, entry);
+
+    // not in the log (yet), so all we have are the mtimes
+    ali_da_foreach(&node->srcs, ali_usize, index) {
+        Ali_Build_Node* src = &nodes->items[*index];
+        ali__build_node_stat(src);
+        if (!src->exists || src->mtime > node->mtime) return true;
+    }
+    ali_da_foreach(&node->deps, ali_usize, index) {
+        Ali_Build_Node* dep = &nodes->items[*index];
+        ali__build_node_stat(dep);
+        if (!dep->exists || dep->mtime > node->mtime) return true;
+    }
+
+    if (node->type == ALI_STEP_OBJECT) {
+        Ali_Arena_Mark stamp = ali_tstamp();
+        Ali_Depfile* depfile = ali_depfiles_update(&nodes->depfiles, node->name, ali__build_node_depfile(node));
+        ali_trewind(stamp);
+
+        if (depfile != NULL) {
+            ali_da_foreach(&depfile->headers, char*, header) {
+                ali_i64 header_mtime = 0;
+                // a header that went away has to be rebuilt without it
+                if (!ali_file_mtime(*header, &header_mtime)) return true;
+                if (header_mtime > node->mtime) return true;
+            }
+        }
     }
 
-    return file1_time > st.st_mtim.tv_sec;
+    return false;
 }
 
-bool ali_rename(const char* from, const char* to) {
-    if (rename(from, to) < 0) {
-        ali_log_error("Couldn't rename %s to %s: %s", from, to, ali_libc_get_error());
-        return false;
+// remembers what node is built from, so the next build can skip it without checking the graph
+void ali__build_node_record(Ali_Build_Nodes* nodes, Ali_Build_Node* node) {
+    ali__build_node_stat(node);
+    if (!node->exists) return;
+
+    Ali_Build_Log_Entry* entry = ali_build_log_record(&nodes->log, node->name, node->cmd_hash, node->mtime);
+    ali_da_foreach(&node->srcs, ali_usize, index) {
+        Ali_Build_Node* src = &nodes->items[*index];
+        ali__build_node_stat(src);
+        ali_build_log_add_input(&nodes->log, entry, src->name, src->mtime);
+    }
+    ali_da_foreach(&node->deps, ali_usize, index) {
+        Ali_Build_Node* dep = &nodes->items[*index];
+        ali__build_node_stat(dep);
+        ali_build_log_add_input(&nodes->log, entry, dep->name, dep->mtime);
     }
-    return true;
-}
 
-bool ali_remove(const char* filepath) {
-    if (remove(filepath) < 0) {
-        ali_log_error("Couldn't remove %s: %s", filepath, ali_libc_get_error());
-        return false;
+    if (node->type == ALI_STEP_OBJECT) {
+        Ali_Depfile* depfile = ali_depfiles_find(&nodes->depfiles, node->name);
+        if (depfile != NULL) {
+            ali_da_foreach(&depfile->headers, char*, header) {
+                // the depfile starts with the source itself
+                bool is_src = false;
+                ali_da_foreach(&node->srcs, ali_usize, index) {
+                    if (strcmp(nodes->items[*index].name, *header) == 0) is_src = true;
+                }
+                if (is_src) continue;
+
+                ali_i64 mtime = 0;
+                if (!ali_file_mtime(*header, &mtime)) continue;
+                ali_build_log_add_input(&nodes->log, entry, *header, mtime);
+            }
+        }
     }
-    return true;
 }
 
-bool ali_mkdir_if_not_exists(const char* path) {
-    if (mkdir(path, 0775) < 0) {
-        switch (errno) {
-            case EEXIST:
-                ali_log_info("Directory %s already exists", path);
-                break; // ignore
-            default:
-                ali_log_error("Couldn't create directory: %s", ali_libc_get_error());
-                return false;
-        }
+void ali__build_node_render_cmd(Ali_Build_Nodes* nodes, Ali_Build_Node* node, Ali_Cmd* cmd) {
+    Ali_Step* step = node->step;
+    switch (node->type) {
+        case ALI_STEP_FILE: {}break; // no build step required, just a file
+        case ALI_STEP_EXE: {
+            ali_cmd_append_many(cmd, "gcc", ali__debug_to_str[step->debug], ali__optimize_to_str[step->optimize]);
+            ali_cmd_append_many(cmd, "-o", node->name);
+            ali_da_foreach(&node->srcs, ali_usize, index) {
+                ali_cmd_append(cmd, nodes->items[*index].name);
+            }
+            ali_da_foreach(&step->linker_flags, char*, lflag) {
+                char* flag = ali_tsprintf("-Wl,%s", *lflag);
+                ali_cmd_append(cmd, flag);
+            }
+        }break;
+        case ALI_STEP_STATIC: {
+            ali_cmd_append_many(cmd, "ar", "rcs", node->name);
+            ali_da_foreach(&node->srcs, ali_usize, index) {
+                ali_cmd_append(cmd, nodes->items[*index].name);
+            }
+            // ar does not do linking
+        }break;
+        case ALI_STEP_DYNAMIC: {
+            ali_cmd_append_many(cmd, "gcc", ali__debug_to_str[step->debug], ali__optimize_to_str[step->optimize]);
+            ali_cmd_append_many(cmd, "-shared", "-fPIC");
+            ali_cmd_append_many(cmd, "-o", node->name);
+            ali_da_foreach(&node->srcs, ali_usize, index) {
+                ali_cmd_append(cmd, nodes->items[*index].name);
+            }
+            ali_da_foreach(&step->linker_flags, char*, lflag) {
+                char* flag = ali_tsprintf("-Wl,%s", *lflag);
+                ali_cmd_append(cmd, flag);
+            }
+        }break;
+        case ALI_STEP_OBJECT: {
+            ali_cmd_append_many(cmd, "gcc", ali__debug_to_str[step->debug], ali__optimize_to_str[step->optimize]);
+            // objects of a shared library have to be position independent
+            if (step->type == ALI_STEP_DYNAMIC) ali_cmd_append_many(cmd, "-fPIC");
+            ali_cmd_append_many(cmd, "-MMD", "-MF", ali__build_node_depfile(node));
+            ali_cmd_append_many(cmd, "-c", "-o", node->name);
+            ali_da_foreach(&node->srcs, ali_usize, index) {
+                // the includes of a unity file are relative to the cwd, not to the build dir
+                if (nodes->items[*index].generated != NULL) ali_cmd_append_many(cmd, "-iquote", ".");
+                ali_cmd_append(cmd, nodes->items[*index].name);
+            }
+        }break;
+        default:
+            ali_unreachable();
     }
-    return true;
 }
 
-bool ali_mkdir_deep_if_not_exists(const char* path) {
-    static char buffer[1024] = {0};
-
-    const char* slash = strchr(path, '/');
-    while (slash != NULL) {
-        memcpy(buffer, path, slash - path);
-        buffer[slash - path] = 0;
-        if (strcmp(buffer, ".") != 0) {
-            if (!ali_mkdir_if_not_exists(buffer)) return false;
-        }
-        slash = strchr(slash + 1, '/');
-    }
-    if (!ali_mkdir_if_not_exists(path)) return false;
+// appends path and two hashes of its contents to key
+bool ali__build_cache_hash_file(Ali_Sb* key, const char* path) {
+    Ali_Sv content = {0};
+    if (!ali_sv_read_file_mmap(path, &content)) return false;
+
+    ali_u64 hashes[2] = {
+        ali_hash_bytes(content.start, content.len, 0),
+        ali_hash_bytes(content.start, content.len, 1),
+    };
+    ali_da_append_many(key, path, strlen(path) + 1);
+    ali_da_append_many(key, (char*)hashes, sizeof(hashes));
 
+    ali_sv_unmap_file(content);
     return true;
 }
 
-Ali_Job ali_job_start_posix(char** cmd, ali_usize cmd_count, AliJobRedirect redirect) {
-    Ali_Job job = {0};
-    job.handle = -1;
-
-    bool should_redirect_stdin = (redirect & ALI_REDIRECT_STDIN) != 0;
-    bool should_redirect_stdout = (redirect & ALI_REDIRECT_STDOUT) != 0;
-    bool should_redirect_stderr = (redirect & ALI_REDIRECT_STDERR) != 0;
+// hash of the cmd and the contents of srcs/deps
+bool ali__build_cache_key(Ali_Build_Nodes* nodes, Ali_Build_Node* node, Ali_Cmd* cmd) {
+    bool result = true;
+    Ali_Sb key = {0};
 
-    if (should_redirect_stdout || should_redirect_stderr) {
-        if (ali_pipe2(job.out)) return job;
+    ali_da_foreach(cmd, char*, arg) {
+        ali_da_append_many(&key, *arg, strlen(*arg) + 1);
     }
-
-    if (should_redirect_stdin) {
-        if (ali_pipe2(job.in)) return job;
+    ali_da_foreach(&node->srcs, ali_usize, index) {
+        if (!ali__build_cache_hash_file(&key, nodes->items[*index].name)) ali_return_defer(false);
+    }
+    ali_da_foreach(&node->deps, ali_usize, index) {
+        if (!ali__build_cache_hash_file(&key, nodes->items[*index].name)) ali_return_defer(false);
     }
 
-    char** cmd_copy = ali_alloc_ex(ali_libc_allocator, sizeof(cmd[0]) * (cmd_count + 1));
-    memcpy(cmd_copy, cmd, sizeof(cmd[0]) * cmd_count);
-    cmd_copy[cmd_count] = NULL;
-
-    job.handle = fork();
-    if (job.handle < 0) {
-        ali_log_error("Couldn't start process: %d", job.handle);
-        return job;
-    } else if (job.handle == 0) {
-        if (should_redirect_stdin) {
-            dup2(STDIN_FILENO, job.in[0]);
-            close(job.in[1]);
-        }
-
-        if (should_redirect_stdout) {
-            dup2(STDOUT_FILENO, job.out[1]);
-            close(job.out[0]);
-        }
-
-        if (should_redirect_stderr) {
-            dup2(STDERR_FILENO, job.out[1]);
-            close(job.out[0]);
-        }
+    node->cache_key[0] = ali_hash_bytes(key.items, key.count, 0);
+    node->cache_key[1] = ali_hash_bytes(key.items, key.count, 1);
+    node->has_cache_key = true;
 
-        execvp(cmd_copy[0], cmd_copy);
-        ali_log_error("Couldn't start program '%s': %s", cmd[0], ali_libc_get_error());
-        exit(1);
-    }
+defer:
+    ali_da_free(&key);
+    return result;
+}
 
-    ali_free_ex(ali_libc_allocator, cmd_copy);
-    return job;
+char* ali__build_cache_manifest(Ali_Build_Nodes* nodes, Ali_Build_Node* node) {
+    return ali_tsprintf("%s/%016llx%016llx.manifest", nodes->cache_dir,
+                        (unsigned long long)node->cache_key[0], (unsigned long long)node->cache_key[1]);
 }
 
-bool ali_job_wait_posix(Ali_Job job) {
-    for (;;) {
-        int wstatus;
-        if (waitpid(job.handle, &wstatus, 0) < 0) {
-            ali_log_error("Couldn't wait for process: %s", ali_libc_get_error());
-            return false;
+// Where the output of node is stored in the cache, allocated in the temporary buffer.
+// The output of an object also depends on its headers, so they are hashed in too. The headers
+// are taken from the manifest, the depfile of the last compile with the same cache_key.
+// NULL if there is no manifest yet.
+char* ali__build_cache_output(Ali_Build_Nodes* nodes, Ali_Build_Node* node) {
+    Ali_Sb key = {0};
+    ali_da_append_many(&key, (char*)node->cache_key, sizeof(node->cache_key));
+
+    if (node->type == ALI_STEP_OBJECT) {
+        Ali_Sv manifest = {0};
+        Ali_Cstrs headers = {0};
+
+        bool ok = ali_sv_read_file_mmap(ali__build_cache_manifest(nodes, node), &manifest);
+        if (ok) {
+            ali_depfile_parse(manifest, &nodes->depfiles.headers_interner, &headers);
+            ali_sv_unmap_file(manifest);
         }
-
-        if (WIFEXITED(wstatus)) {
-            int estatus = WEXITSTATUS(wstatus);
-            if (estatus != 0) {
-                ali_log_error("Process exited with status %d", estatus);
-                return false;
-            }
-
-            break; 
+        ali_da_foreach(&headers, char*, header) {
+            if (ok && !ali__build_cache_hash_file(&key, *header)) ok = false;
         }
 
-        if (WIFSIGNALED(wstatus)) {
-            ali_log_error("Process exited with signal %d", WTERMSIG(wstatus));
-            return false;
+        ali_da_free(&headers);
+        if (!ok) {
+            ali_da_free(&key);
+            return NULL;
         }
     }
 
-    return true;
-}
-
-Ali_Job ali_job_start(char** cmd, ali_usize cmd_count, AliJobRedirect redirect) {
-#ifdef _WIN32
-#error "TODO: windows"
-#else // _WIN32
-    return ali_job_start_posix(cmd, cmd_count, redirect);
-#endif // _WIN32
+    char* output = ali_tsprintf("%s/%016llx%016llx", nodes->cache_dir,
+                                (unsigned long long)ali_hash_bytes(key.items, key.count, 0),
+                                (unsigned long long)ali_hash_bytes(key.items, key.count, 1));
+    ali_da_free(&key);
+    return output;
 }
 
-bool ali_job_wait(Ali_Job job) {
-#ifdef _WIN32
-#error "TODO: windows"
-#else // _WIN32
-    return ali_job_wait_posix(job);
-#endif // _WIN32
+// copies to a temporary file first, so to is never half written (or busy, if it's running)
+bool ali__build_cache_copy(const char* from, const char* to) {
+    char* tmp = ali_tsprintf("%s.tmp", to);
+    if (!ali_copy_file(from, tmp)) return false;
+    return ali_rename(tmp, to);
 }
 
-bool ali_job_run(char **cmd, ali_usize cmd_count, AliJobRedirect redirect) {
-    Ali_Job job = ali_job_start(cmd, cmd_count, redirect);
-    return ali_job_wait(job);
-}
+bool ali__build_cache_restore(Ali_Build_Nodes* nodes, Ali_Build_Node* node, Ali_Cmd* cmd) {
+    if (nodes->cache_dir == NULL || node->type == ALI_STEP_FILE) return false;
+    if (!ali__build_cache_key(nodes, node, cmd)) return false;
 
-bool ali_jobs_wait(Ali_Jobs jobs) {
     bool result = true;
-    ali_da_foreach(&jobs, Ali_Job, job) {
-        if (!ali_job_wait(*job)) result = false;
-    }
-    return result;
-}
+    Ali_Arena_Mark stamp = ali_tstamp();
 
-bool ali_jobs_wait_and_reset(Ali_Jobs* jobs) {
-    bool result = true;
-    ali_da_foreach(jobs, Ali_Job, job) {
-        if (!ali_job_wait(*job)) result = false;
+    char* cached = ali__build_cache_output(nodes, node);
+    if (cached == NULL || access(cached, F_OK) < 0) ali_return_defer(false);
+
+    if (!ali__build_cache_copy(cached, node->name)) ali_return_defer(false);
+    if (node->type == ALI_STEP_OBJECT) {
+        if (!ali__build_cache_copy(ali_tsprintf("%s.d", cached), ali__build_node_depfile(node))) ali_return_defer(false);
     }
-    jobs->count = 0;
+    ali_log_info("[CACHE] Restored %s", node->name);
+
+defer:
+    ali_trewind(stamp);
     return result;
 }
 
-void ali_cmd_append_many_null(Ali_Cmd* cmd, char* arg1, ...) {
-    ali_cmd_append(cmd, arg1);
+void ali__build_cache_store(Ali_Build_Nodes* nodes, Ali_Build_Node* node) {
+    if (!node->has_cache_key) return;
 
-    va_list args;
-    va_start(args, arg1);
-    char* arg = va_arg(args, char*);
-    while (arg != NULL) {
-        ali_cmd_append(cmd, arg);
-        arg = va_arg(args, char*);
+    Ali_Arena_Mark stamp = ali_tstamp();
+    if (node->type == ALI_STEP_OBJECT) {
+        if (!ali__build_cache_copy(ali__build_node_depfile(node), ali__build_cache_manifest(nodes, node))) goto defer;
     }
-    va_end(args);
-}
 
-Ali_Job ali_cmd_run_async(Ali_Cmd cmd, AliJobRedirect redirect) {
-    Ali_Sb sb = {0};
-    ali_sb_render_cmd(&sb, cmd.items, cmd.count);
-
-    Ali_Sv rendered = ali_sb_to_sv(&sb);
-    ali_log_info("[CMD] "SV_FMT, SV_F(rendered));
+    char* cached = ali__build_cache_output(nodes, node);
+    if (cached == NULL) goto defer;
+    if (!ali__build_cache_copy(node->name, cached)) goto defer;
+    if (node->type == ALI_STEP_OBJECT) {
+        ali__build_cache_copy(ali__build_node_depfile(node), ali_tsprintf("%s.d", cached));
+    }
 
-    ali_da_free(&sb);
-    Ali_Job job = ali_job_start(cmd.items, cmd.count, redirect);
-    return job;
+defer:
+    ali_trewind(stamp);
 }
 
-bool ali_cmd_run_sync(Ali_Cmd cmd) {
-    Ali_Job job = ali_cmd_run_async(cmd, 0);
-    return ali_job_wait(job);
+// the output of node just changed, by running its cmd or restoring it from the cache
+void ali__build_node_built(Ali_Build_Nodes* nodes, Ali_Build_Node* node, bool from_cache) {
+    node->rebuilt = true;
+    node->stated = false;
+    if (ali_global_stat_cache != NULL) ali_stat_cache_invalidate(ali_global_stat_cache, node->name);
+    if (node->type == ALI_STEP_OBJECT) {
+        // parse the new depfile now, so the next build doesn't have to
+        Ali_Arena_Mark stamp = ali_tstamp();
+        char* depfile = ali__build_node_depfile(node);
+        if (ali_global_stat_cache != NULL) ali_stat_cache_invalidate(ali_global_stat_cache, depfile);
+        ali_depfiles_update(&nodes->depfiles, node->name, depfile);
+        ali_trewind(stamp);
+    }
+    if (!from_cache) ali__build_cache_store(nodes, node);
+    ali__build_node_record(nodes, node);
 }
 
-Ali_Job ali_cmd_run_async_and_reset(Ali_Cmd* cmd, AliJobRedirect redirect) {
-    Ali_Sb sb = {0};
-    ali_sb_render_cmd(&sb, cmd->items, cmd->count);
-
-    Ali_Sv rendered = ali_sb_to_sv(&sb);
-    ali_log_info("[CMD] "SV_FMT, SV_F(rendered));
+void ali__build_node_finish(Ali_Build_Nodes* nodes, Ali_Indices* ready, ali_usize node_index, bool ok) {
+    Ali_Build_Node* node = &nodes->items[node_index];
+    node->state = ok ? ALI_NODE_DONE : ALI_NODE_FAILED;
+    if (!ok) return;
 
-    ali_da_free(&sb);
-    Ali_Job job = ali_job_start(cmd->items, cmd->count, redirect);
-    cmd->count = 0;
-    return job;
+    ali_da_foreach(&node->dependents, ali_usize, index) {
+        Ali_Build_Node* dependent = &nodes->items[*index];
+        ali_assert(dependent->pending > 0);
+        if (--dependent->pending == 0) ali_da_append(ready, *index);
+    }
 }
 
-bool ali_cmd_run_sync_and_reset(Ali_Cmd* cmd) {
-    Ali_Job job = ali_cmd_run_async_and_reset(cmd, 0);
-    return ali_job_wait(job);
+// lanes->items[i] is 1 while something runs on lane i
+ali_usize ali__build_lane_take(Ali_Indices* lanes) {
+    for (ali_usize i = 0; i < lanes->count; ++i) {
+        if (!lanes->items[i]) {
+            lanes->items[i] = 1;
+            return i;
+        }
+    }
+    ali_da_append(lanes, (ali_usize)1);
+    return lanes->count - 1;
 }
 
-const char* ali__debug_to_str[ALI_DEBUG_COUNT_] = {
-    [ALI_DEBUG_NONE] = "-g0",
-    [ALI_DEBUG_AUTO] = "-g",
-    [ALI_DEBUG_GDB] = "-ggdb",
-};
-
-const char* ali__optimize_to_str[ALI_OPTIMIZE_COUNT_] = {
-    [ALI_OPTIMIZE_NONE] = "-O0",
-    [ALI_OPTIMIZE_ONE] = "-O1",
-    [ALI_OPTIMIZE_TWO] = "-O2",
-    [ALI_OPTIMIZE_THREE] = "-O3",
-    [ALI_OPTIMIZE_FAST] = "-Ofast",
-    [ALI_OPTIMIZE_SIZE] = "-Os",
-    [ALI_OPTIMIZE_SIZE_AGRESSIVE] = "-Oz",
+const char* ali__step_type_to_str[] = {
+    [ALI_STEP_FILE] = "file",
+    [ALI_STEP_EXE] = "executable",
+    [ALI_STEP_STATIC] = "static",
+    [ALI_STEP_DYNAMIC] = "dynamic",
+    [ALI_STEP_OBJECT] = "object",
 };
 
-void ali_step_free(Ali_Step* step) {
-    ali_da_foreach(&step->srcs, Ali_Step, substep) {
-        ali_step_free(substep);
-    }
-    ali_da_free(&step->srcs);
-    ali_da_foreach(&step->deps, Ali_Step, substep) {
-        ali_step_free(substep);
+void ali__sb_append_json_string(Ali_Sb* sb, const char* s) {
+    ali_da_append(sb, (char)'"');
+    for (; *s != '\0'; ++s) {
+        if (*s == '"' || *s == '\\') {
+            ali_da_append(sb, (char)'\\');
+            ali_da_append(sb, *s);
+        } else if ((unsigned char)*s < 0x20) {
+            ali_sb_sprintf(sb, "\\u%04x", *s);
+        } else {
+            ali_da_append(sb, *s);
+        }
     }
-    ali_da_free(&step->deps);
-    ali_da_free(&step->linker_flags);
+    ali_da_append(sb, (char)'"');
 }
 
-bool ali_step_need_rebuild(Ali_Step* step) {
-    ali_da_foreach(&step->srcs, Ali_Step, substep) {
-        if (ali_step_need_rebuild(substep)) return true;
-        if (ali_need_rebuild(step->name, substep->name)) return true;
+bool ali_build_nodes_write_trace(Ali_Build_Nodes* nodes, const char* path) {
+    Ali_Sb sb = {0};
+    ali_sb_sprintf(&sb, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    bool first = true;
+    ali_da_foreach(nodes, Ali_Build_Node, node) {
+        if (!node->worked) continue;
+
+        ali_sb_sprintf(&sb, "%s\n{\"name\":", first ? "" : ",");
+        ali__sb_append_json_string(&sb, node->name);
+        ali_sb_sprintf(&sb, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f,",
+                       ali__step_type_to_str[node->type], node->lane,
+                       (node->start_ns - nodes->start_ns) / 1e3, (node->end_ns - node->start_ns) / 1e3);
+        ali_sb_sprintf(&sb, "\"args\":{\"exit_code\":%d,\"max_rss_kib\":%ld,\"from_cache\":%s}}",
+                       node->exit_code, node->max_rss_kib, node->from_cache ? "true" : "false");
+        first = false;
     }
-    ali_da_foreach(&step->deps, Ali_Step, substep) {
-        if (ali_step_need_rebuild(substep)) return true;
-        if (ali_need_rebuild(step->name, substep->name)) return true;
+    ali_sb_sprintf(&sb, "\n]}\n");
+
+    bool result = true;
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        ali_log_error("Couldn't open %s: %s", path, ali_libc_get_error());
+        ali_return_defer(false);
+    }
+    if (fwrite(sb.items, 1, sb.count, f) != sb.count) {
+        ali_log_error("Couldn't write %s: %s", path, ali_libc_get_error());
+        ali_return_defer(false);
     }
-    return false;
-}
 
-Ali_Step ali_step_file(char* name) {
-    return (Ali_Step) {
-        .name = name,
-        .type = ALI_STEP_FILE,
-    };
+defer:
+    if (f != NULL) fclose(f);
+    ali_da_free(&sb);
+    return result;
 }
 
-Ali_Step ali_step_executable(char* name, Ali_Debug_Type debug, Ali_Optimize_Type optimize) {
-    return (Ali_Step) {
-        .name = name,
-        .type = ALI_STEP_EXE,
-        .debug = debug,
-        .optimize = optimize,
-    };
-}
+void ali_build_nodes_report_critical_path(Ali_Build_Nodes* nodes) {
+    if (nodes->count == 0) return;
+
+    // finish[i] is the time it takes to build node i with infinitely many cores
+    ali_u64* finish = ali_alloc_ex(ali_libc_allocator, sizeof(*finish) * nodes->count);
+    ali_isize* prev = ali_alloc_ex(ali_libc_allocator, sizeof(*prev) * nodes->count);
+    Ali_Indices path = {0};
+    ali_usize last = 0;
+    ali_u64 work_ns = 0;
+    ali_isize max_rss_index = -1;
+
+    // srcs and deps always come before the nodes that use them, so one pass is enough
+    for (ali_usize i = 0; i < nodes->count; ++i) {
+        Ali_Build_Node* node = &nodes->items[i];
+        ali_u64 duration = node->worked ? node->end_ns - node->start_ns : 0;
+        work_ns += duration;
+        if (node->worked && (max_rss_index < 0 || node->max_rss_kib > nodes->items[max_rss_index].max_rss_kib)) {
+            max_rss_index = i;
+        }
 
-Ali_Step ali_step_dynamic(char* name, Ali_Debug_Type debug, Ali_Optimize_Type optimize) {
-    return (Ali_Step) {
-        .name = name,
-        .type = ALI_STEP_DYNAMIC,
-        .debug = debug,
-        .optimize = optimize,
-    };
-}
+        ali_u64 longest = 0;
+        prev[i] = -1;
+        // anything after i can only be there through a cycle, which never got built anyway
+        ali_da_foreach(&node->srcs, ali_usize, index) {
+            if (*index < i && finish[*index] > longest) longest = finish[*index], prev[i] = *index;
+        }
+        ali_da_foreach(&node->deps, ali_usize, index) {
+            if (*index < i && finish[*index] > longest) longest = finish[*index], prev[i] = *index;
+        }
+        finish[i] = longest + duration;
+        if (finish[i] > finish[last]) last = i;
+    }
+    if (finish[last] == 0) goto defer;
 
-Ali_Step ali_step_static(char* name, Ali_Debug_Type debug, Ali_Optimize_Type optimize) {
-    return (Ali_Step) {
-        .name = name,
-        .type = ALI_STEP_STATIC,
-        .debug = debug,
-        .optimize = optimize,
-    };
-}
+    for (ali_isize i = last; i >= 0; i = prev[i]) {
+        if (nodes->items[i].worked) ali_da_append(&path, i);
+    }
 
-void ali_step_add_src(Ali_Step* step, Ali_Step substep) {
-    ali_da_append(&step->srcs, substep);
-}
+    ali_u64 wall_ns = nodes->end_ns - nodes->start_ns;
+    ali_log_info("[BUILD] Critical path %.3fs, wall time %.3fs, %.3fs of work (%.2fx parallel)",
+                 finish[last] / 1e9, wall_ns / 1e9, work_ns / 1e9, wall_ns > 0 ? (double)work_ns / wall_ns : 0.0);
+    while (path.count > 0) {
+        Ali_Build_Node* node = &nodes->items[path.items[--path.count]];
+        ali_log_info("[BUILD]   %8.3fs %s%s", (node->end_ns - node->start_ns) / 1e9, node->name,
+                     node->from_cache ? " (from cache)" : "");
+    }
+    if (max_rss_index >= 0 && nodes->items[max_rss_index].max_rss_kib > 0) {
+        ali_log_info("[BUILD] Highest peak RSS %ld KiB (%s)",
+                     nodes->items[max_rss_index].max_rss_kib, nodes->items[max_rss_index].name);
+    }
 
-void ali_step_add_dep(Ali_Step* step, Ali_Step substep) {
-    ali_da_append(&step->deps, substep);
+defer:
+    ali_free_ex(ali_libc_allocator, finish);
+    ali_free_ex(ali_libc_allocator, prev);
+    ali_da_free(&path);
 }
 
-bool ali_step_build(Ali_Step* step, Ali_Jobs* jobs, ali_usize cores) {
-    if (jobs->count >= cores) {
-        if (!ali_jobs_wait_and_reset(jobs)) return false;
-    }
+bool ali_build_nodes_run(Ali_Build_Nodes* nodes, Ali_Job_Pool* jobs, ali_usize cores) {
+    if (cores == 0) cores = 1;
 
     bool result = true;
-
-    ali_usize stamp = ali_tstamp();
+    Ali_Indices ready = {0};
+    Ali_Indices lanes = {0};
     Ali_Cmd cmd = {0};
-    bool need_rebuild = ali_step_need_rebuild(step);
-    if (!need_rebuild) ali_return_defer(true);
+    nodes->start_ns = ali_monotonic_ns();
+
+    Ali_Stat_Cache stat_cache = {0};
+    Ali_Stat_Cache* prev_stat_cache = ali_global_stat_cache;
+    if (prev_stat_cache == NULL) ali_global_stat_cache = &stat_cache;
+
+    // the paths below (and anything else put in the temporary buffer) live until the end of the build
+    Ali_Arena_Mark build_stamp = ali_tstamp();
+    char* depfiles_path = ali_tsprintf("%s/deps", ali__build_dir(nodes));
+    ali_depfiles_free(&nodes->depfiles);
+    ali_depfiles_load(&nodes->depfiles, depfiles_path);
+    char* log_path = ali_tsprintf("%s/log", ali__build_dir(nodes));
+    ali_build_log_free(&nodes->log);
+    ali_build_log_load(&nodes->log, log_path);
+    if (nodes->cache_dir != NULL && !ali_mkdir_deep_if_not_exists(nodes->cache_dir)) {
+        ali_log_warn("[CACHE] Building without the cache");
+        nodes->cache_dir = NULL;
+    }
 
-    switch (step->type) {
-        case ALI_STEP_FILE: {}break; // no build step required, just a file
-        case ALI_STEP_EXE: {
-            ali_cmd_append_many(&cmd, "gcc", ali__debug_to_str[step->debug], ali__optimize_to_str[step->optimize]);
-            ali_cmd_append_many(&cmd, "-o", step->name);
-            ali_da_foreach(&step->srcs, Ali_Step, substep) {
-                if (!ali_step_build(substep, jobs, cores)) ali_return_defer(false);
-                ali_da_append(&cmd, substep->name);
-            }
-            ali_da_foreach(&step->deps, Ali_Step, substep) {
-                if (!ali_step_build(substep, jobs, cores)) ali_return_defer(false);
-            }
-            ali_da_foreach(&step->linker_flags, char*, lflag) {
-                char* flag = ali_tsprintf("-Wl,%s", *lflag);
-                ali_cmd_append_many(&cmd, flag);
-            }
-            Ali_Job step_job = ali_cmd_run_async(cmd, 0);
-            ali_da_append(jobs, step_job);
-        }break;
-        case ALI_STEP_STATIC: {
-            ali_cmd_append_many(&cmd, "ar", "rcs", step->name);
-            ali_da_foreach(&step->srcs, Ali_Step, substep) {
-                if (!ali_step_build(substep, jobs, cores)) ali_return_defer(false);
-                ali_da_append(&cmd, substep->name);
+    for (ali_usize i = 0; i < nodes->count; ++i) {
+        Ali_Build_Node* node = &nodes->items[i];
+        node->state = ALI_NODE_WAITING;
+        node->rebuilt = false;
+        node->has_cache_key = false;
+        node->stated = false;
+        node->worked = false;
+        node->pending = node->srcs.count + node->deps.count;
+    }
+    for (ali_usize i = 0; i < nodes->count; ++i) {
+        if (nodes->items[i].pending == 0) ali_da_append(&ready, i);
+    }
+
+    for (;;) {
+        while (result && ready.count > 0 && jobs->count < cores) {
+            ali_usize node_index = ready.items[--ready.count];
+            Ali_Build_Node* node = &nodes->items[node_index];
+
+            if (node->generated != NULL && !ali__build_write_unity_file(node->name, node->generated)) {
+                ali_log_error("[BUILD] Couldn't generate %s", node->name);
+                result = false;
+                ali__build_node_finish(nodes, &ready, node_index, false);
+                continue;
             }
-            ali_da_foreach(&step->deps, Ali_Step, substep) {
-                if (!ali_step_build(substep, jobs, cores)) ali_return_defer(false);
+
+            Ali_Arena_Mark stamp = ali_tstamp();
+            ali__build_node_render_cmd(nodes, node, &cmd);
+            node->cmd_hash = ali__build_cmd_hash(&cmd);
+
+            if (!ali__build_node_need_rebuild(nodes, node)) {
+                if (node->type != ALI_STEP_FILE) {
+                    ali_log_info("[BUILD] No need to build %s", node->name);
+                    if (ali_build_log_find(&nodes->log, node->name) == NULL) ali__build_node_record(nodes, node);
+                }
+                ali_da_clear(&cmd);
+                ali_trewind(stamp);
+                ali__build_node_finish(nodes, &ready, node_index, true);
+                continue;
             }
-            // ar does not do linking
-            Ali_Job step_job = ali_cmd_run_async(cmd, 0);
-            ali_da_append(jobs, step_job);
-        }break;
-        case ALI_STEP_DYNAMIC: {
-            ali_cmd_append_many(&cmd, "gcc", ali__debug_to_str[step->debug], ali__optimize_to_str[step->optimize]);
-            ali_cmd_append_many(&cmd, "-shared", "-fPIC");
-            ali_cmd_append_many(&cmd, "-o", step->name);
-            ali_da_foreach(&step->srcs, Ali_Step, substep) {
-                if (!ali_step_build(substep, jobs, cores)) ali_return_defer(false);
-                ali_da_append(&cmd, substep->name);
+
+            ali_log_info("[BUILD] Build %s", node->name);
+            if (node->type == ALI_STEP_OBJECT) {
+                const char* slash = strrchr(node->name, '/');
+                char* dir = ali_tsprintf("%.*s", (int)(slash - node->name), node->name);
+                if (!ali_mkdir_deep_if_not_exists(dir)) {
+                    ali_da_clear(&cmd);
+                    ali_trewind(stamp);
+                    result = false;
+                    ali__build_node_finish(nodes, &ready, node_index, false);
+                    continue;
+                }
             }
-            ali_da_foreach(&step->deps, Ali_Step, substep) {
-                if (!ali_step_build(substep, jobs, cores)) ali_return_defer(false);
+            ali_u64 start_ns = ali_monotonic_ns();
+            if (ali__build_cache_restore(nodes, node, &cmd)) {
+                ali_da_clear(&cmd);
+                ali_trewind(stamp);
+                node->worked = true;
+                node->from_cache = true;
+                node->start_ns = start_ns;
+                node->end_ns = ali_monotonic_ns();
+                node->exit_code = 0;
+                node->max_rss_kib = 0;
+                node->lane = ali__build_lane_take(&lanes);
+                lanes.items[node->lane] = 0;
+                ali__build_node_built(nodes, node, true);
+                ali__build_node_finish(nodes, &ready, node_index, true);
+                continue;
             }
-            ali_da_foreach(&step->linker_flags, char*, lflag) {
-                char* flag = ali_tsprintf("-Wl,%s", *lflag);
-                ali_cmd_append_many(&cmd, flag);
+            bool started = ali_job_pool_start(jobs, &cmd, node_index);
+            ali_trewind(stamp);
+            if (!started) {
+                result = false;
+                ali__build_node_finish(nodes, &ready, node_index, false);
+                continue;
             }
-            Ali_Job step_job = ali_cmd_run_async(cmd, 0);
-            ali_da_append(jobs, step_job);
-        }break;
-        default:
-            ali_unreachable();
-    }
 
-defer:
-    if (result && step->type != ALI_STEP_FILE) {
-        if (need_rebuild) {
-            ali_log_info("[BUILD] Build %s", step->name);
+            node->state = ALI_NODE_RUNNING;
+            node->lane = ali__build_lane_take(&lanes);
+        }
+
+        // either everything is done or something failed and we are waiting for the rest
+        if (jobs->count == 0) break;
+
+        Ali_Job_Result job_result = {0};
+        bool ok = ali_job_pool_wait_any(jobs, &job_result);
+        if (!job_result.reaped) {
+            result = false;
+            continue;
+        }
+        ali_usize node_index = job_result.id;
+
+        Ali_Build_Node* node = &nodes->items[node_index];
+        node->worked = true;
+        node->from_cache = false;
+        node->start_ns = job_result.start_ns;
+        node->end_ns = job_result.end_ns;
+        node->exit_code = job_result.exit_code;
+        node->max_rss_kib = job_result.max_rss_kib;
+        lanes.items[node->lane] = 0;
+        if (!ok) {
+            ali_log_error("[BUILD] Failed to build %s", node->name);
+            result = false;
         } else {
-            ali_log_info("[BUILD] No need to build %s", step->name);
+            ali_log_info("[BUILD] Built %s in %.3fs", node->name, (node->end_ns - node->start_ns) / 1e9);
+            ali__build_node_built(nodes, node, false);
         }
+        ali__build_node_finish(nodes, &ready, node_index, ok);
     }
 
-    ali_trewind(stamp);
+    // a cycle, or the dependents of something that failed
+    ali_da_foreach(nodes, Ali_Build_Node, node) {
+        if (node->state != ALI_NODE_WAITING) continue;
+        ali_log_error("[BUILD] Never got to build %s, %zu of its srcs/deps didn't finish", node->name, node->pending);
+        result = false;
+    }
+
+    nodes->end_ns = ali_monotonic_ns();
+
+    // a build that had nothing to do keeps the trace of the last one that did something
+    bool worked = false;
+    ali_da_foreach(nodes, Ali_Build_Node, node) {
+        if (node->worked) worked = true;
+    }
+    if (ali_mkdir_deep_if_not_exists(ali__build_dir(nodes))) {
+        if (nodes->depfiles.dirty) ali_depfiles_save(&nodes->depfiles, depfiles_path);
+        if (nodes->log.dirty) ali_build_log_save(&nodes->log, log_path);
+        if (worked) ali_build_nodes_write_trace(nodes, ali_tsprintf("%s/trace.json", ali__build_dir(nodes)));
+    }
+    ali_build_nodes_report_critical_path(nodes);
+
+    if (ali_global_stat_cache == &stat_cache) {
+        ali_log_info("[BUILD] %llu calls to stat(), %llu saved by the stat cache",
+                     (unsigned long long)stat_cache.stat_calls, (unsigned long long)stat_cache.saved_calls);
+        ali_stat_cache_free(&stat_cache);
+    }
+    ali_global_stat_cache = prev_stat_cache;
+
+    ali_trewind(build_stamp);
     ali_da_free(&cmd);
+    ali_da_free(&lanes);
+    ali_da_free(&ready);
+    return result;
+}
+
+bool ali_step_build(Ali_Step* step, Ali_Job_Pool* jobs, ali_usize cores) {
+    Ali_Build_Nodes nodes = {0};
+    ali_build_nodes_add_step(&nodes, step);
+    bool result = ali_build_nodes_run(&nodes, jobs, cores);
+    ali_build_nodes_free(&nodes);
     return result;
 }
 
@@ -1710,23 +5358,54 @@ void ali_build_free(Ali_Build* b) {
     ali_da_foreach(b, Ali_Step, step) {
         ali_step_free(step);
     }
-    ali_jobs_wait(b->jobs);
-    ali_da_free(&b->jobs);
+    ali_job_pool_free(&b->jobs);
+    ali_build_nodes_free(&b->nodes);
     ali_da_free(b);
 }
 
 bool ali_build_build(Ali_Build* b, ali_usize cores) {
+    ali_build_nodes_free(&b->nodes);
+    b->nodes.build_dir = b->build_dir;
+    b->nodes.cache_dir = b->cache_dir;
     ali_da_foreach(b, Ali_Step, step) {
-        if (!ali_step_build(step, &b->jobs, cores)) return false;
+        ali_build_nodes_add_step(&b->nodes, step);
     }
-    return true;
+    return ali_build_nodes_run(&b->nodes, &b->jobs, cores);
 }
 
 bool ali_build_clean(Ali_Build* b) {
+    bool result = true;
+
+    // go through the nodes so the objects of .c srcs get removed too
+    Ali_Build_Nodes nodes = {0};
+    nodes.build_dir = b->build_dir;
     ali_da_foreach(b, Ali_Step, step) {
-        if (!ali_step_clean(step)) return false;
+        ali_build_nodes_add_step(&nodes, step);
     }
-    return true;
+    ali_da_foreach(&nodes, Ali_Build_Node, node) {
+        if (node->type == ALI_STEP_FILE && node->generated == NULL) continue;
+        if (node->type == ALI_STEP_OBJECT) {
+            Ali_Arena_Mark stamp = ali_tstamp();
+            char* depfile = ali__build_node_depfile(node);
+            bool ok = access(depfile, F_OK) < 0 || ali_remove(depfile);
+            ali_trewind(stamp);
+            if (!ok) ali_return_defer(false);
+        }
+        if (access(node->name, F_OK) < 0) continue;
+        if (!ali_remove(node->name)) ali_return_defer(false);
+    }
+    // the unity files get a directory of their own, take it away if nothing else is left in there
+    ali_da_foreach(&nodes, Ali_Build_Node, node) {
+        if (node->generated == NULL) continue;
+        Ali_Arena_Mark stamp = ali_tstamp();
+        const char* slash = strrchr(node->name, '/');
+        rmdir(ali_tsprintf("%.*s", (int)(slash - node->name), node->name));
+        ali_trewind(stamp);
+    }
+
+defer:
+    ali_build_nodes_free(&nodes);
+    return result;
 }
 
 #endif // ALI_IMPLEMENTATION
@@ -1750,12 +5429,26 @@ typedef ali_usize usize;
 
 typedef Ali_Sb Sb;
 typedef Ali_Sv Sv;
+typedef Ali_Svs Svs;
+typedef Ali_Tokenizer Tokenizer;
 typedef Ali_Allocator Allocator;
 typedef Ali_Allocator_Action Allocator_Action;
 typedef Ali_Location Location;
 typedef Ali_Arena Arena;
 typedef Ali_Dynamic_Arena Dynamic_Arena;
+typedef Ali_Scratch Scratch;
+typedef Ali_Tracking_Allocator Tracking_Allocator;
+typedef Ali_Pool_Allocator Pool_Allocator;
+typedef Ali_Atomic_Arena Atomic_Arena;
+#ifndef _WIN32
+typedef Ali_Thread_Cache_Allocator Thread_Cache_Allocator;
+typedef Ali_Vm_Arena Vm_Arena;
+typedef Ali_Vm_Arena_Options Vm_Arena_Options;
+#endif // _WIN32
 typedef Ali_Slice Slice;
+typedef Ali_Hm_Table Hm_Table;
+typedef Ali_Interned Interned;
+typedef Ali_Interner Interner;
 typedef Ali_Job Job;
 typedef Ali_Logger Logger;
 
@@ -1793,6 +5486,8 @@ typedef Ali_Logger Logger;
 #define flag_print_usage ali_flag_print_usage
 
 #define da_resize_for ali_da_resize_for
+#define da_reserve ali_da_reserve
+#define da_shrink_to_fit ali_da_shrink_to_fit
 #define da_append ali_da_append
 #define da_shallow_append ali_da_shallow_append
 #define da_append_many ali_da_append_many
@@ -1806,6 +5501,31 @@ typedef Ali_Logger Logger;
 #define arena_create ali_arena_create
 #define arena_allocator ali_arena_allocator
 #define arena_reset ali_arena_reset
+#define dynamic_arena_mark ali_dynamic_arena_mark
+#define dynamic_arena_rollback ali_dynamic_arena_rollback
+#define dynamic_arena_reset ali_dynamic_arena_reset
+#define dynamic_arena_stats ali_dynamic_arena_stats
+#define scratch_begin ali_scratch_begin
+#define scratch_end ali_scratch_end
+#define scratch_allocator ali_scratch_allocator
+#define track_allocator ali_track_allocator
+#define tracking_allocator ali_tracking_allocator
+#define tracking_allocator_free ali_tracking_allocator_free
+#define log_tracked ali_log_tracked
+#define dynamic_arena_allocator ali_dynamic_arena_allocator
+#define pool_allocator ali_pool_allocator
+#define atomic_arena_mark ali_atomic_arena_mark
+#define atomic_arena_rollback ali_atomic_arena_rollback
+#define atomic_arena_reset ali_atomic_arena_reset
+#define atomic_arena_allocator ali_atomic_arena_allocator
+#define thread_cache_allocator_init ali_thread_cache_allocator_init
+#define thread_cache_allocator_destroy ali_thread_cache_allocator_destroy
+#define thread_cache_allocator ali_thread_cache_allocator
+#define vm_arena_init ali_vm_arena_init
+#define vm_arena_init_ex ali_vm_arena_init_ex
+#define vm_arena_reset ali_vm_arena_reset
+#define vm_arena_destroy ali_vm_arena_destroy
+#define vm_arena_allocator ali_vm_arena_allocator
 
 #define sb_to_sv ali_sb_to_sv
 #define sb_to_cstr ali_sb_to_cstr
@@ -1817,6 +5537,18 @@ typedef Ali_Logger Logger;
 #define sv_strip_suffix ali_sv_strip_suffix
 #define sv_starts_with_prefix ali_sv_starts_with_prefix
 #define sv_ends_with_suffix ali_sv_ends_with_suffix
+#define sv_find_byte ali_sv_find_byte
+#define sv_find ali_sv_find
+#define sv_count_byte ali_sv_count_byte
+#define sv_chop_by_delim ali_sv_chop_by_delim
+#define sv_split_by ali_sv_split_by
+#define sv_chop_u64 ali_sv_chop_u64
+#define sv_chop_i64 ali_sv_chop_i64
+#define sv_read_file_mmap ali_sv_read_file_mmap
+#define sv_unmap_file ali_sv_unmap_file
+#define tokenizer ali_tokenizer
+#define tokenizer_next ali_tokenizer_next
+#define tokenizer_next_line ali_tokenizer_next_line
 
 #define slice_is_of_type ali_slice_is_of_type
 #define slice_from_parts ali_slice_from_parts
@@ -1826,16 +5558,38 @@ typedef Ali_Logger Logger;
 #define slice_get ali_slice_get
 #define slice_foreach ali_slice_foreach
 
+#define hm_find ali_hm_find
+#define hm_entry ali_hm_entry
+#define hm_put ali_hm_put
+#define hm_remove ali_hm_remove
+#define hm_count ali_hm_count
+#define hm_clear ali_hm_clear
+#define hm_free ali_hm_free
+#define hm_foreach ali_hm_foreach
+
+#define intern ali_intern
+#define intern_cstr ali_intern_cstr
+#define interner_get ali_interner_get
+#define interner_free ali_interner_free
+
 #define job_start ali_job_start
+#define job_start_argv ali_job_start_argv
 #define job_wait ali_job_wait
 #define job_run ali_job_run
 #define jobs_wait ali_jobs_wait
 #define jobs_wait_and_reset ali_jobs_wait_and_reset
+#define jobs_wait_any ali_jobs_wait_any
+#define job_pool_start ali_job_pool_start
+#define job_pool_wait_any ali_job_pool_wait_any
+#define job_pool_wait_all ali_job_pool_wait_all
+#define job_pool_free ali_job_pool_free
 
 #define is_file1_modified_after_file2 ali_is_file1_modified_after_file2
 #define need_rebuild ali_need_rebuild
 #define mkdir_if_not_exists ali_mkdir_if_not_exists
 #define mkdir_deep_if_not_exists ali_mkdir_deep_if_not_exists
+#define copy_file ali_copy_file
+#define file_mtime ali_file_mtime
 
 #define cmd_append ali_cmd_append
 #define cmd_append_many ali_cmd_append_many
@@ -0,0 +1,262 @@
+#define ALI2_IMPLEMENTATION
+#define ALI2_REMOVE_PREFIX
+#include "../ali2.h"
+
+// Every allocator of the library on the same workloads:
+//   small    - many small allocations that all stay live, freed one by one at the end
+//   da       - 64 dynamic arrays of u64 growing in turns with ali_da_append
+//   churn    - a window of 4096 live blocks, every op frees a random one and allocates a new one
+//   threads  - churn on 8 threads at once, only for the allocators that are thread safe
+// Each run happens in its own process so the RSS of one doesn't leak into the next. rss_bytes
+// is how much the resident set grew while everything was still live, and fragmentation is that
+// divided by the bytes that were live at that point.
+// usage: bench/allocators [ops]
+
+#define DA_ARRAYS 64
+#define CHURN_WINDOW 4096
+#define THREADS 8
+
+typedef enum {
+    LIBC,
+    ARENA,
+    DYNAMIC_ARENA,
+    POOL,
+    THREAD_CACHE,
+    VM_ARENA,
+    ATOMIC_ARENA,
+    ALLOCATOR_COUNT,
+}Which;
+
+static const char* allocator_names[ALLOCATOR_COUNT] = {
+    [LIBC] = "libc",
+    [ARENA] = "arena",
+    [DYNAMIC_ARENA] = "dynamic_arena",
+    [POOL] = "pool",
+    [THREAD_CACHE] = "thread_cache",
+    [VM_ARENA] = "vm_arena",
+    [ATOMIC_ARENA] = "atomic_arena",
+};
+
+static bool thread_safe[ALLOCATOR_COUNT] = {
+    [LIBC] = true,
+    [THREAD_CACHE] = true,
+    [ATOMIC_ARENA] = true,
+};
+
+typedef struct {
+    u64 ops;
+    usize live_bytes;
+    usize rss_bytes;
+}Run;
+
+static usize rss_bytes(void) {
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (f == NULL) return 0;
+    usize pages = 0, resident = 0;
+    if (fscanf(f, "%zu %zu", &pages, &resident) != 2) resident = 0;
+    fclose(f);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static u64 xorshift(u64* state) {
+    u64 x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static Allocator allocator_create(Which which) {
+    // every run has its own process, so these can just live here
+    static Arena arena;
+    static Dynamic_Arena dynamic_arena;
+    static Pool_Allocator pool;
+    static Thread_Cache_Allocator thread_cache;
+    static Vm_Arena vm_arena;
+    static Atomic_Arena atomic_arena;
+
+    switch (which) {
+        case LIBC: return ali_libc_allocator;
+        case ARENA: {
+            // the churn workload never gives anything back
+            arena = arena_create((usize)2 << 30);
+            return arena_allocator(&arena);
+        }
+        case DYNAMIC_ARENA: return dynamic_arena_allocator(&dynamic_arena);
+        case POOL: return pool_allocator(&pool);
+        case THREAD_CACHE: {
+            if (!thread_cache_allocator_init(&thread_cache, ali_libc_allocator)) exit(1);
+            return thread_cache_allocator(&thread_cache);
+        }
+        case VM_ARENA: {
+            if (!vm_arena_init(&vm_arena, (usize)16 << 30)) exit(1);
+            return vm_arena_allocator(&vm_arena);
+        }
+        case ATOMIC_ARENA: return atomic_arena_allocator(&atomic_arena);
+        case ALLOCATOR_COUNT: break;
+    }
+    ali_unreachable();
+}
+
+static Run bench_small(Allocator allocator, usize ops) {
+    void** ptrs = malloc(ops * sizeof(*ptrs));
+    memset(ptrs, 0, ops * sizeof(*ptrs)); // so it doesn't count towards rss_bytes
+    u64 rng = 0x9e3779b97f4a7c15;
+    Run run = { .ops = ops };
+
+    usize rss = rss_bytes();
+    for (usize i = 0; i < ops; ++i) {
+        usize size = 16 + xorshift(&rng) % 113;
+        ptrs[i] = ali_alloc_ex(allocator, size);
+        memset(ptrs[i], 1, size);
+        run.live_bytes += size;
+    }
+    run.rss_bytes = rss_bytes() - rss;
+
+    for (usize i = 0; i < ops; ++i) ali_free_ex(allocator, ptrs[i]);
+    free(ptrs);
+    return run;
+}
+
+typedef struct {
+    DA(u64);
+}U64s;
+
+static Run bench_da(Allocator allocator, usize ops) {
+    U64s arrays[DA_ARRAYS] = {0};
+    for (usize i = 0; i < DA_ARRAYS; ++i) arrays[i].allocator = allocator;
+    Run run = { .ops = ops };
+
+    usize rss = rss_bytes();
+    for (usize i = 0; i < ops; ++i) da_append(&arrays[i % DA_ARRAYS], (u64)i);
+    run.rss_bytes = rss_bytes() - rss;
+
+    for (usize i = 0; i < DA_ARRAYS; ++i) {
+        run.live_bytes += arrays[i].count * sizeof(u64);
+        da_free(&arrays[i]);
+    }
+    return run;
+}
+
+typedef struct {
+    Allocator allocator;
+    usize ops;
+    u64 seed;
+    usize live_bytes;
+    void* window[CHURN_WINDOW];
+    usize sizes[CHURN_WINDOW];
+}Churn;
+
+static void churn(Churn* c) {
+    u64 rng = c->seed;
+    for (usize i = 0; i < CHURN_WINDOW; ++i) {
+        c->sizes[i] = 16 + xorshift(&rng) % 497;
+        c->window[i] = ali_alloc_ex(c->allocator, c->sizes[i]);
+        c->live_bytes += c->sizes[i];
+    }
+    for (usize i = 0; i < c->ops; ++i) {
+        usize slot = xorshift(&rng) % CHURN_WINDOW;
+        ali_free_ex(c->allocator, c->window[slot]);
+        c->live_bytes -= c->sizes[slot];
+        c->sizes[slot] = 16 + xorshift(&rng) % 497;
+        c->window[slot] = ali_alloc_ex(c->allocator, c->sizes[slot]);
+        memset(c->window[slot], 1, c->sizes[slot]);
+        c->live_bytes += c->sizes[slot];
+    }
+}
+
+static void churn_free(Churn* c) {
+    for (usize i = 0; i < CHURN_WINDOW; ++i) ali_free_ex(c->allocator, c->window[i]);
+}
+
+static Run bench_churn(Allocator allocator, usize ops) {
+    Churn* c = calloc(1, sizeof(*c));
+    c->allocator = allocator;
+    c->ops = ops;
+    c->seed = 0x9e3779b97f4a7c15;
+
+    usize rss = rss_bytes();
+    churn(c);
+    Run run = { .ops = ops, .live_bytes = c->live_bytes, .rss_bytes = rss_bytes() - rss };
+
+    churn_free(c);
+    free(c);
+    return run;
+}
+
+static void* churn_thread(void* arg) {
+    churn(arg);
+    return NULL;
+}
+
+static Run bench_threads(Allocator allocator, usize ops) {
+    Churn* c = calloc(THREADS, sizeof(*c));
+    pthread_t threads[THREADS];
+    Run run = { .ops = ops / THREADS * THREADS };
+
+    usize rss = rss_bytes();
+    for (usize i = 0; i < THREADS; ++i) {
+        c[i].allocator = allocator;
+        c[i].ops = ops / THREADS;
+        c[i].seed = 0x9e3779b97f4a7c15 * (i + 1);
+        if (pthread_create(&threads[i], NULL, churn_thread, &c[i]) != 0) exit(1);
+    }
+    for (usize i = 0; i < THREADS; ++i) pthread_join(threads[i], NULL);
+    run.rss_bytes = rss_bytes() - rss;
+
+    for (usize i = 0; i < THREADS; ++i) {
+        run.live_bytes += c[i].live_bytes;
+        churn_free(&c[i]);
+    }
+    free(c);
+    return run;
+}
+
+typedef struct {
+    const char* name;
+    Run (*run)(Allocator allocator, usize ops);
+    bool threaded;
+}Workload;
+
+static Workload workloads[] = {
+    { "small", bench_small, false },
+    { "da", bench_da, false },
+    { "churn", bench_churn, false },
+    { "threads", bench_threads, true },
+};
+
+int main(int argc, char** argv) {
+    usize ops = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+
+    printf("allocator,workload,threads,ops,ns_per_op,live_bytes,rss_bytes,fragmentation\n");
+    fflush(stdout);
+    for (usize w = 0; w < array_len(workloads); ++w) {
+        for (Which which = 0; which < ALLOCATOR_COUNT; ++which) {
+            if (workloads[w].threaded && !thread_safe[which]) continue;
+
+            pid_t pid = fork();
+            assert(pid >= 0);
+            if (pid == 0) {
+                Allocator allocator = allocator_create(which);
+                u64 start_ns = ali_monotonic_ns();
+                Run run = workloads[w].run(allocator, ops);
+                double ns_per_op = (double)(ali_monotonic_ns() - start_ns) / run.ops;
+
+                printf("%s,%s,%d,%llu,%.1f,%zu,%zu,%.2f\n", allocator_names[which], workloads[w].name,
+                       workloads[w].threaded ? THREADS : 1, (unsigned long long)run.ops, ns_per_op,
+                       run.live_bytes, run.rss_bytes, (double)run.rss_bytes / run.live_bytes);
+                fflush(stdout);
+                _exit(0);
+            }
+
+            int wstatus = 0;
+            waitpid(pid, &wstatus, 0);
+            if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+                log_error("%s on %s crashed", allocator_names[which], workloads[w].name);
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+#define ALI2_IMPLEMENTATION
+#define ALI2_REMOVE_PREFIX
+#include "../ali2.h"
+
+// How much of an arena dynamic array growth eats: a da of u64 living in the arena grows with
+// ali_da_append, either alone or interleaved with a small allocation after every grow, so only
+// the first workload can grow in place.
+// usage: bench/arena_growth [items]
+
+typedef struct {
+    DA(u64);
+}U64s;
+
+static void run(Allocator allocator, usize items, bool interleaved) {
+    U64s g = { .allocator = allocator };
+    for (usize i = 0; i < items; ++i) {
+        usize capacity = g.capacity;
+        da_append(&g, (u64)i);
+        if (interleaved && g.capacity != capacity) ali_alloc_ex(allocator, 16);
+    }
+    for (usize i = 0; i < items; ++i) assert(g.items[i] == i);
+}
+
+static usize dynamic_arena_used(Dynamic_Arena* arena) {
+    usize used = 0;
+    for (Ali_Arena_Chunk* chunk = arena->start; chunk != NULL; chunk = chunk->next) used += chunk->size;
+    return used;
+}
+
+static usize dynamic_arena_reserved(Dynamic_Arena* arena) {
+    usize reserved = 0;
+    for (Ali_Arena_Chunk* chunk = arena->start; chunk != NULL; chunk = chunk->next) reserved += chunk->capacity;
+    return reserved;
+}
+
+int main(int argc, char** argv) {
+    usize items = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    const char* workloads[] = { "alone", "interleaved" };
+
+    printf("arena,workload,array_bytes,used_bytes,reserved_bytes,used_per_array_byte\n");
+    for (usize w = 0; w < array_len(workloads); ++w) {
+        // the final capacity of the array, counted the same way as ali_da_resize_for does
+        usize capacity = ALI_DA_INIT_CAPACITY;
+        while (capacity <= items) capacity = ALI_DA_GROW(capacity);
+        usize array_bytes = capacity * sizeof(u64);
+
+        Arena arena = arena_create(array_bytes * 4);
+        run(arena_allocator(&arena), items, w == 1);
+        printf("arena,%s,%zu,%zu,%zu,%.2f\n", workloads[w], array_bytes, arena.size, arena.capacity, (double)arena.size / array_bytes);
+        ali_freeall_ex(arena_allocator(&arena));
+
+        Dynamic_Arena dynamic = {0};
+        run(dynamic_arena_allocator(&dynamic), items, w == 1);
+        usize used = dynamic_arena_used(&dynamic);
+        printf("dynamic_arena,%s,%zu,%zu,%zu,%.2f\n", workloads[w], array_bytes, used, dynamic_arena_reserved(&dynamic), (double)used / array_bytes);
+        ali_freeall_ex(dynamic_arena_allocator(&dynamic));
+    }
+
+    return 0;
+}
@@ -0,0 +1,169 @@
+#define ALI2_IMPLEMENTATION
+#define ALI2_REMOVE_PREFIX
+#include "../ali2.h"
+
+// Lookups of path-like keys in a linear scan over a da (what the build graph and the build log
+// used to do), a naive chained hash table and HM. Half of the lookups are hits and half misses.
+// The linear scan is skipped past 4096 keys, it would take forever.
+// usage: bench/hashmap [lookups]
+
+typedef struct {
+    Sv key;
+    usize value;
+}Pair;
+
+typedef struct {
+    DA(Pair);
+}Pairs;
+
+static usize linear_find(Pairs* pairs, Sv key) {
+    da_foreach(pairs, Pair, pair) {
+        if (ali_sv_eq(pair->key, key)) return pair->value;
+    }
+    return 0;
+}
+
+typedef struct Chain {
+    Sv key;
+    usize value;
+    struct Chain* next;
+}Chain;
+
+typedef struct {
+    Chain** buckets;
+    usize count, capacity;
+}Chained;
+
+static void chained_put(Chained* chained, Sv key, usize value) {
+    if (chained->count >= chained->capacity) {
+        usize capacity = chained->capacity == 0 ? 16 : chained->capacity * 2;
+        Chain** buckets = calloc(capacity, sizeof(*buckets));
+        for (usize i = 0; i < chained->capacity; ++i) {
+            for (Chain* chain = chained->buckets[i]; chain != NULL;) {
+                Chain* next = chain->next;
+                usize bucket = ali_hash_bytes(chain->key.start, chain->key.len, 0) & (capacity - 1);
+                chain->next = buckets[bucket];
+                buckets[bucket] = chain;
+                chain = next;
+            }
+        }
+        free(chained->buckets);
+        chained->buckets = buckets;
+        chained->capacity = capacity;
+    }
+
+    usize bucket = ali_hash_bytes(key.start, key.len, 0) & (chained->capacity - 1);
+    Chain* chain = malloc(sizeof(*chain));
+    *chain = (Chain) { .key = key, .value = value, .next = chained->buckets[bucket] };
+    chained->buckets[bucket] = chain;
+    chained->count++;
+}
+
+static usize chained_find(Chained* chained, Sv key) {
+    usize bucket = ali_hash_bytes(key.start, key.len, 0) & (chained->capacity - 1);
+    for (Chain* chain = chained->buckets[bucket]; chain != NULL; chain = chain->next) {
+        if (ali_sv_eq(chain->key, key)) return chain->value;
+    }
+    return 0;
+}
+
+static void chained_free(Chained* chained) {
+    for (usize i = 0; i < chained->capacity; ++i) {
+        for (Chain* chain = chained->buckets[i]; chain != NULL;) {
+            Chain* next = chain->next;
+            free(chain);
+            chain = next;
+        }
+    }
+    free(chained->buckets);
+}
+
+typedef struct {
+    HM(usize);
+}Map;
+
+// key i of the set, misses are the odd ones and never get inserted
+static char* make_key(usize i) {
+    char key[64];
+    snprintf(key, sizeof(key), ".build/src/module_%zu/file_%zu.o", i % 97, i);
+    return strdup(key);
+}
+
+static u64 xorshift(u64* state) {
+    u64 x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+int main(int argc, char** argv) {
+    usize lookups = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    usize sizes[] = { 16, 256, 4096, 65536 };
+
+    printf("container,keys,insert_ns_per_key,lookup_ns\n");
+    for (usize s = 0; s < array_len(sizes); ++s) {
+        usize n = sizes[s];
+        char** keys = malloc(2 * n * sizeof(*keys));
+        for (usize i = 0; i < 2 * n; ++i) keys[i] = make_key(i);
+
+        // the same sequence of keys for all of them
+        usize* order = malloc(lookups * sizeof(*order));
+        u64 rng = 0x9e3779b97f4a7c15;
+        for (usize i = 0; i < lookups; ++i) order[i] = xorshift(&rng) % (2 * n);
+
+        usize checksum = 0;
+        u64 start_ns = 0;
+
+        if (n <= 4096) {
+            Pairs pairs = {0};
+            start_ns = ali_monotonic_ns();
+            for (usize i = 0; i < 2 * n; i += 2) {
+                Pair pair = { sv_from_cstr(keys[i]), i + 1 };
+                da_append(&pairs, pair);
+            }
+            double insert_ns = (double)(ali_monotonic_ns() - start_ns) / n;
+
+            start_ns = ali_monotonic_ns();
+            for (usize i = 0; i < lookups; ++i) checksum += linear_find(&pairs, sv_from_cstr(keys[order[i]]));
+            printf("linear,%zu,%.1f,%.1f\n", n, insert_ns, (double)(ali_monotonic_ns() - start_ns) / lookups);
+            da_free(&pairs);
+        }
+
+        {
+            Chained chained = {0};
+            start_ns = ali_monotonic_ns();
+            for (usize i = 0; i < 2 * n; i += 2) chained_put(&chained, sv_from_cstr(keys[i]), i + 1);
+            double insert_ns = (double)(ali_monotonic_ns() - start_ns) / n;
+
+            start_ns = ali_monotonic_ns();
+            for (usize i = 0; i < lookups; ++i) checksum += chained_find(&chained, sv_from_cstr(keys[order[i]]));
+            printf("chained,%zu,%.1f,%.1f\n", n, insert_ns, (double)(ali_monotonic_ns() - start_ns) / lookups);
+            chained_free(&chained);
+        }
+
+        {
+            Map map = {0};
+            start_ns = ali_monotonic_ns();
+            for (usize i = 0; i < 2 * n; i += 2) hm_put(&map, sv_from_cstr(keys[i]), i + 1);
+            double insert_ns = (double)(ali_monotonic_ns() - start_ns) / n;
+
+            start_ns = ali_monotonic_ns();
+            for (usize i = 0; i < lookups; ++i) {
+                usize* value = hm_find(&map, sv_from_cstr(keys[order[i]]));
+                if (value != NULL) checksum += *value;
+            }
+            printf("hm,%zu,%.1f,%.1f\n", n, insert_ns, (double)(ali_monotonic_ns() - start_ns) / lookups);
+            hm_free(&map);
+        }
+
+        // so none of the lookups can be thrown away
+        if (checksum == 42) printf("\n");
+
+        for (usize i = 0; i < 2 * n; ++i) free(keys[i]);
+        free(keys);
+        free(order);
+    }
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+#define ALI2_IMPLEMENTATION
+#define ALI2_REMOVE_PREFIX
+#include "../ali2.h"
+
+// Every tier of the byte loops behind ali_mem_eq, ali_sv_find_byte and ali_sv_count_byte on the
+// same buffers, next to what libc has for them. find_byte looks for a byte that is only in the
+// last position, so every kernel goes through the whole buffer.
+// usage: bench/simd [bytes per row]
+
+typedef bool (*Mem_Eq)(const u8* a, const u8* b, usize size);
+typedef isize (*Find_Byte)(const u8* data, usize size, u8 byte);
+typedef usize (*Count_Byte)(const u8* data, usize size, u8 byte);
+
+static bool libc_mem_eq(const u8* a, const u8* b, usize size) {
+    return memcmp(a, b, size) == 0;
+}
+
+static isize libc_find_byte(const u8* data, usize size, u8 byte) {
+    const u8* found = memchr(data, byte, size);
+    return found != NULL ? found - data : -1;
+}
+
+typedef struct {
+    const char* name;
+    Mem_Eq mem_eq;
+    Find_Byte find_byte;
+    Count_Byte count_byte;
+    bool (*supported)(void);
+}Tier;
+
+static bool always(void) {
+    return true;
+}
+
+#ifdef ALI__SIMD_X86
+static bool has_avx2(void) {
+    return __builtin_cpu_supports("avx2");
+}
+#endif // ALI__SIMD_X86
+
+static Tier tiers[] = {
+    { "libc", libc_mem_eq, libc_find_byte, NULL, always },
+    { "scalar", ali__mem_eq_scalar, ali__find_byte_scalar, ali__count_byte_scalar, always },
+#ifdef ALI__SIMD_X86
+    { "sse2", ali__mem_eq_sse2, ali__find_byte_sse2, ali__count_byte_sse2, always },
+    { "avx2", ali__mem_eq_avx2, ali__find_byte_avx2, ali__count_byte_avx2, has_avx2 },
+#endif // ALI__SIMD_X86
+};
+
+// read through a volatile, so the calls can't be inlined or hoisted out of the loops
+static Tier* volatile current;
+
+int main(int argc, char** argv) {
+    usize budget = argc > 1 ? strtoull(argv[1], NULL, 10) : (usize)1 << 28;
+    usize sizes[] = { 8, 31, 64, 4096, 1 << 20 };
+
+    usize max_size = sizes[array_len(sizes) - 1];
+    u8* a = malloc(max_size);
+    u8* b = malloc(max_size);
+    for (usize i = 0; i < max_size; ++i) a[i] = b[i] = 'a' + i % 23;
+
+    usize checksum = 0;
+    printf("tier,bytes,mem_eq_ns,find_byte_ns,count_byte_ns\n");
+    for (usize s = 0; s < array_len(sizes); ++s) {
+        usize size = sizes[s];
+        usize reps = budget / size > 10000000 ? 10000000 : budget / size;
+        a[size - 1] = '!';
+        b[size - 1] = '!';
+
+        for (usize t = 0; t < array_len(tiers); ++t) {
+            if (!tiers[t].supported()) continue;
+            current = &tiers[t];
+
+            u64 start_ns = ali_monotonic_ns();
+            for (usize i = 0; i < reps; ++i) checksum += current->mem_eq(a, b, size);
+            double mem_eq_ns = (double)(ali_monotonic_ns() - start_ns) / reps;
+
+            start_ns = ali_monotonic_ns();
+            for (usize i = 0; i < reps; ++i) checksum += current->find_byte(a, size, '!');
+            double find_byte_ns = (double)(ali_monotonic_ns() - start_ns) / reps;
+
+            printf("%s,%zu,%.1f,%.1f,", tiers[t].name, size, mem_eq_ns, find_byte_ns);
+            if (current->count_byte != NULL) {
+                start_ns = ali_monotonic_ns();
+                for (usize i = 0; i < reps; ++i) checksum += current->count_byte(a, size, 'a');
+                printf("%.1f\n", (double)(ali_monotonic_ns() - start_ns) / reps);
+            } else {
+                printf("\n");
+            }
+        }
+
+        a[size - 1] = 'a' + (size - 1) % 23;
+        b[size - 1] = a[size - 1];
+    }
+
+    // so none of the calls can be thrown away
+    if (checksum == 42) printf("\n");
+
+    free(a);
+    free(b);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#define ALI2_IMPLEMENTATION
+#define ALI2_REMOVE_PREFIX
+#include "../ali2.h"
+
+// Spawn latency of the fork and posix_spawn paths of the job launcher, once with a small heap
+// and once with a big one, since fork has to copy the page tables of the whole driver.
+// usage: bench/spawn [spawns] [heap MiB]
+
+static u64 now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static double bench_spawn(Job (*start)(char** argv, AliJobRedirect redirect), usize spawns) {
+    char* argv[] = { "true", NULL };
+
+    u64 start_ns = now_ns();
+    for (usize i = 0; i < spawns; ++i) {
+        Job job = start(argv, 0);
+        if (job.handle < 0 || !job_wait(job)) {
+            log_error("Couldn't run `true`");
+            exit(1);
+        }
+    }
+    return (double)(now_ns() - start_ns) / spawns;
+}
+
+int main(int argc, char** argv) {
+    usize spawns = argc > 1 ? strtoull(argv[1], NULL, 10) : 500;
+    usize heap_mib = argc > 2 ? strtoull(argv[2], NULL, 10) : 1024;
+
+    printf("method,heap_mib,spawns,ns_per_spawn\n");
+    printf("fork,0,%zu,%.0f\n", spawns, bench_spawn(ali_job_start_posix_fork, spawns));
+    printf("posix_spawn,0,%zu,%.0f\n", spawns, bench_spawn(ali_job_start_posix_spawn, spawns));
+
+    // touch every page, so they are all mapped when we fork
+    u8* heap = malloc(heap_mib << 20);
+    assert(heap != NULL);
+    memset(heap, 1, heap_mib << 20);
+
+    printf("fork,%zu,%zu,%.0f\n", heap_mib, spawns, bench_spawn(ali_job_start_posix_fork, spawns));
+    printf("posix_spawn,%zu,%zu,%.0f\n", heap_mib, spawns, bench_spawn(ali_job_start_posix_spawn, spawns));
+
+    free(heap);
+    return 0;
+}
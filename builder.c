@@ -16,6 +16,36 @@ int main(int argc, char** argv) {
         ali_build_install(&b, exe);
     }
 
+    {
+        Ali_Step bench = ali_step_executable("bench/spawn", ALI_DEBUG_NONE, ALI_OPTIMIZE_TWO);
+        ali_step_add_src(&bench, ali_step_file("bench/spawn.c"));
+        ali_build_install(&b, bench);
+    }
+
+    {
+        Ali_Step bench = ali_step_executable("bench/arena_growth", ALI_DEBUG_NONE, ALI_OPTIMIZE_TWO);
+        ali_step_add_src(&bench, ali_step_file("bench/arena_growth.c"));
+        ali_build_install(&b, bench);
+    }
+
+    {
+        Ali_Step bench = ali_step_executable("bench/allocators", ALI_DEBUG_NONE, ALI_OPTIMIZE_TWO);
+        ali_step_add_src(&bench, ali_step_file("bench/allocators.c"));
+        ali_build_install(&b, bench);
+    }
+
+    {
+        Ali_Step bench = ali_step_executable("bench/hashmap", ALI_DEBUG_NONE, ALI_OPTIMIZE_TWO);
+        ali_step_add_src(&bench, ali_step_file("bench/hashmap.c"));
+        ali_build_install(&b, bench);
+    }
+
+    {
+        Ali_Step bench = ali_step_executable("bench/simd", ALI_DEBUG_NONE, ALI_OPTIMIZE_TWO);
+        ali_step_add_src(&bench, ali_step_file("bench/simd.c"));
+        ali_build_install(&b, bench);
+    }
+
     if (!ali_build_build(&b, 1)) return 1;
     ali_build_free(&b);
 